@@ -624,6 +624,17 @@ local _PTRemoveFromList = function(list, object)
     end
 end
 
+-- Incremented whenever a rendering list is reordered,
+-- so the engine knows to recapture the scene.
+local _PTRenderRevision = 0
+
+local _PTSortByDepth = function(list)
+    table.sort(list, function(a, b)
+        return a.z < b.z
+    end)
+    _PTRenderRevision = _PTRenderRevision + 1
+end
+
 --- Callbacks
 -- @section callbacks
 
@@ -2032,7 +2043,7 @@ FLIP_H = 0x01
 FLIP_V = 0x02
 
 --- Get the dimensions of an image.
--- @tparam table image @{PTImage}/@{PT9Slice} to query.
+-- @tparam table image @{PTImage}/@{PT9Slice}/@{PTTextLayout} to query.
 -- @treturn integer Width of the image.
 -- @treturn integer Height of the image.
 PTGetImageDims = function(image)
@@ -2041,7 +2052,7 @@ PTGetImageDims = function(image)
     end
     if image._type == "PTImage" then
         return _PTGetImageDims(image.ptr)
-    elseif image._type == "PT9Slice" then
+    elseif image._type == "PT9Slice" or image._type == "PTTextLayout" then
         return image.width, image.height
     end
     return 0, 0
@@ -2103,7 +2114,7 @@ PTSetImageOriginSimple = function(image, origin)
     end
 end
 
---- Blit a @{PTImage}/@{PT9Slice} to the screen.
+--- Blit a @{PTImage}/@{PT9Slice}/@{PTTextLayout} to the screen.
 -- Normally not called directly; Perentie will render
 -- everything in the display lists managed by @{PTRoomAddObject} and
 -- @{PTGlobalAddObject}.
@@ -2115,6 +2126,8 @@ PTDrawImage = function(image, x, y, flags)
     if image then
         if image._type == "PTImage" then
             _PTDrawImage(image.ptr, x, y, flags)
+        elseif image._type == "PTTextLayout" then
+            _PTDrawText(image.ptr, x, y, image.reveal)
         elseif image._type == "PT9Slice" and image.image then
             _PTDraw9Slice(
                 image.image.ptr,
@@ -2133,7 +2146,7 @@ PTDrawImage = function(image, x, y, flags)
 end
 
 --- Perform a collision test for an image.
--- @tparam table image @{PTImage}/@{PT9Slice} to test.
+-- @tparam table image @{PTImage}/@{PT9Slice}/@{PTTextLayout} to test.
 -- @tparam integer x X coordinate in image space.
 -- @tparam integer y Y coordinate in image space.
 -- @tparam integer flags Flags for rendering the image.
@@ -2160,6 +2173,10 @@ PTTestImageCollision = function(image, x, y, flags, collision_mask)
             image.y2
         )
     end
+    if image._type == "PTTextLayout" then
+        -- no mask to test against, so use the bounding box
+        return x >= 0 and y >= 0 and x < image.width and y < image.height
+    end
     return false
 end
 
@@ -2242,6 +2259,39 @@ PTSetOverscanColour = function(colour)
     return _PTSetOverscanColour(colour)
 end
 
+--- Add a palette cycle.
+-- The colours are rotated through each other's palette slots at a fixed rate, like the
+-- waterfall and fire effects in old adventure games. Only the palette is changed; images
+-- using the colours don't need to be redrawn or reconverted.
+-- @tparam table colours List of colours to cycle, each a table containing three 8-bit numbers.
+-- @tparam integer delay Time between each step of the cycle, in milliseconds.
+-- @tparam[opt=false] boolean reverse Whether to cycle the colours in the opposite direction.
+-- @treturn integer ID of the palette cycle, or nil if it couldn't be added.
+PTAddPaletteCycle = function(colours, delay, reverse)
+    return _PTAddPaletteCycle(colours, delay, reverse)
+end
+
+--- Remove a palette cycle, restoring the original colours.
+-- @tparam integer id ID of the palette cycle, returned by @{PTAddPaletteCycle}.
+-- @treturn boolean Whether the palette cycle was removed.
+PTRemovePaletteCycle = function(id)
+    return _PTRemovePaletteCycle(id)
+end
+
+--- Fade the whole palette towards a colour.
+-- @tparam table colour Table containing three 8-bit numbers, or nil to keep the previous fade colour. Defaults to black.
+-- @tparam number amount Amount of the fade colour to mix in, from 0.0 (none) to 1.0 (solid colour).
+-- @tparam[opt=0] integer duration Time taken to reach the new amount, in milliseconds.
+PTFadePalette = function(colour, amount, duration)
+    return _PTFadePalette(colour, amount, duration)
+end
+
+--- Return whether a palette fade is in progress.
+-- @treturn boolean Whether the palette is fading.
+PTIsPaletteFading = function()
+    return _PTIsPaletteFading()
+end
+
 DITHER_NONE = 0
 DITHER_FILL_A = 1
 DITHER_FILL_B = 2
@@ -2298,6 +2348,7 @@ end
 -- @tfield[opt=1] float parallax_x X parallax scaling factor.
 -- @tfield[opt=1] float parallax_y Y parallax scaling factor.
 -- @tfield[opt=false] boolean collision Whether to test this object's sprite mask for collisions; e.g. when updating the current @{PTGetMouseOver} object.
+-- @tfield[opt=false] boolean static Whether this object is part of the scenery. Static objects at the back of a room are composited into a cached layer, which is only redrawn when one of them changes.
 -- @tfield[opt=true] boolean visible Whether to draw this object to the screen.
 -- @table PTBackground
 
@@ -2331,6 +2382,7 @@ PTBackground = function(image, x, y, z, collision)
         parallax_y = 1,
         collision = collision,
         visible = true,
+        static = false,
     }
 end
 
@@ -2397,6 +2449,7 @@ end
 -- @tfield[opt=nil] integer anim_index Index of the current animation from the animations table.
 -- @tfield[opt=0] integer anim_flags Transformation flags to be applied to the frames.
 -- @tfield[opt=false] boolean collision Whether to test this object's sprite mask for collisions; e.g. when updating the current @{PTGetMouseOver} object.
+-- @tfield[opt=false] boolean static Whether this object is part of the scenery. Static objects at the back of a room are composited into a cached layer, which is only redrawn when one of them changes.
 -- @tfield[opt=true] boolean visible Whether to draw this object to the screen.
 -- @table PTSprite
 
@@ -2428,6 +2481,7 @@ PTSprite = function(animations, x, y, z)
         anim_flags = 0,
         collision = false,
         visible = true,
+        static = false,
     }
 end
 
@@ -2524,6 +2578,7 @@ end
 -- @tfield integer z Depth coordinate; a higher number renders to the front.
 -- @tfield integer origin_x Origin x coordinate, relative to top-left corner..
 -- @tfield integer origin_y Origin y coordinate, relative to top-left corner.
+-- @tfield[opt=false] boolean static Whether this object is part of the scenery. Static objects at the back of a room are composited into a cached layer, which is only redrawn when one of them changes.
 -- @tfield[opt=true] boolean visible Whether to draw this object to the screen.
 -- @table PTGroup
 
@@ -2539,9 +2594,7 @@ PTGroup = function(objects, x, y, z, origin_x, origin_y)
     if not objects then
         objects = {}
     end
-    table.sort(objects, function(a, b)
-        return a.z < b.z
-    end)
+    _PTSortByDepth(objects)
     if not x then
         x = 0
     end
@@ -2567,6 +2620,7 @@ PTGroup = function(objects, x, y, z, origin_x, origin_y)
         origin_x = origin_x,
         origin_y = origin_y,
         visible = true,
+        static = false,
     }
 end
 
@@ -2577,9 +2631,7 @@ PTGroupAddObject = function(group, object)
     if object then
         _PTAddToList(group.objects, object)
     end
-    table.sort(group.objects, function(a, b)
-        return a.z < b.z
-    end)
+    _PTSortByDepth(group.objects)
 end
 
 --- Remove a renderable (@{PTActor}/@{PTBackground}/@{PTSprite}/@{PTGroup}) object from a group rendering list.
@@ -2589,9 +2641,7 @@ PTGroupRemoveObject = function(group, object)
     if object then
         _PTRemoveFromList(group.objects, object)
     end
-    table.sort(group.objects, function(a, b)
-        return a.z < b.z
-    end)
+    _PTSortByDepth(group.objects)
 end
 
 --- Iterate through a list of renderable (@{PTActor}/@{PTBackground}/@{PTSprite}/@{PTGroup}) objects. PTGroups will be flattened, leaving only PTActor/PTBackground/PTSprite objects with adjusted positions.
@@ -2721,9 +2771,7 @@ PTGlobalAddObject = function(object)
     if object then
         _PTAddToList(_PTGlobalRenderList, object)
     end
-    table.sort(_PTGlobalRenderList, function(a, b)
-        return a.z < b.z
-    end)
+    _PTSortByDepth(_PTGlobalRenderList)
 end
 
 --- Remove a renderable (@{PTActor}/@{PTBackground}/@{PTSprite}/@{PTGroup}) object from the global rendering list.
@@ -2732,9 +2780,7 @@ PTGlobalRemoveObject = function(object)
     if object then
         _PTRemoveFromList(_PTGlobalRenderList, object)
     end
-    table.sort(_PTGlobalRenderList, function(a, b)
-        return a.z < b.z
-    end)
+    _PTSortByDepth(_PTGlobalRenderList)
 end
 
 --- Movement
@@ -3364,9 +3410,7 @@ PTAddPanel = function(panel)
     if panel and panel._type == "PTPanel" then
         _PTAddToList(_PTPanelList, panel)
     end
-    table.sort(_PTPanelList, function(a, b)
-        return a.z < b.z
-    end)
+    _PTSortByDepth(_PTPanelList)
 end
 
 --- Remove a panel from the engine state.
@@ -3376,9 +3420,7 @@ PTRemovePanel = function(panel)
         error("PTRemovePanel: expected PTPanel for first argument")
     end
     _PTRemoveFromList(_PTPanelList, panel)
-    table.sort(_PTPanelList, function(a, b)
-        return a.z < b.z
-    end)
+    _PTSortByDepth(_PTPanelList)
 end
 
 --- Add a renderable (@{PTBackground}/@{PTSprite}/@{PTGroup}) object to the panel rendering list.
@@ -3389,9 +3431,7 @@ PTPanelAddObject = function(panel, object)
         error("PTPanelAddObject: expected PTPanel for first argument")
     end
     _PTAddToList(panel.objects, object)
-    table.sort(panel.objects, function(a, b)
-        return a.z < b.z
-    end)
+    _PTSortByDepth(panel.objects)
 end
 
 --- Remove a renderable (@{PTBackground}/@{PTSprite}/@{PTGroup}) object from the panel rendering list.
@@ -3402,9 +3442,7 @@ PTPanelRemoveObject = function(panel, object)
         error("PTPanelRemoveObject: expected PTPanel for first argument")
     end
     _PTRemoveFromList(panel.objects, object)
-    table.sort(panel.objects, function(a, b)
-        return a.z < b.z
-    end)
+    _PTSortByDepth(panel.objects)
 end
 
 local _PTWithinRect = function(x, y, width, height, test_x, test_y)
@@ -3483,15 +3521,7 @@ PTFont = function(path)
     return { _type = "PTFont", ptr = _PTFont(path) }
 end
 
---- Create an new image containing rendered text.
--- @tparam string text Unicode text to render.
--- @tparam PTFont font Font object to use.
--- @tparam[opt=200] integer width Width of bounding area in pixels.
--- @tparam[opt="left"] string align Text alignment; one of "left", "center" or "right".
--- @tparam[opt={ 0xff 0xff 0xff }] table colour Inner colour; list of 3 8-bit numbers.
--- @tparam[opt={ 0x00 0x00 0x00 }] table border Border colour; list of 3 8-bit numbers.
--- @treturn PTImage The new image, or nil if the text was unable to be created.
-PTText = function(text, font, width, align, colour, border)
+local _PTTextArgs = function(width, align, colour, border)
     if not width then
         width = 200
     end
@@ -3525,13 +3555,81 @@ PTText = function(text, font, width, align, colour, border)
     if border and border[3] then
         brd_b = border[3]
     end
-    local data = _PTText(text, font.ptr, width, align_enum, r, g, b, brd_r, brd_g, brd_b)
+    return width, align_enum, r, g, b, brd_r, brd_g, brd_b
+end
+
+--- Create an new image containing rendered text.
+-- Recently rendered text is cached, so the result may be shared with earlier calls; see @{PTSetTextCacheBudget}.
+-- @tparam string text Unicode text to render.
+-- @tparam PTFont font Font object to use.
+-- @tparam[opt=200] integer width Width of bounding area in pixels.
+-- @tparam[opt="left"] string align Text alignment; one of "left", "center" or "right".
+-- @tparam[opt={ 0xff 0xff 0xff }] table colour Inner colour; list of 3 8-bit numbers.
+-- @tparam[opt={ 0x00 0x00 0x00 }] table border Border colour; list of 3 8-bit numbers.
+-- @treturn PTImage The new image, or nil if the text was unable to be created.
+PTText = function(text, font, width, align, colour, border)
+    local data = _PTText(text, font.ptr, _PTTextArgs(width, align, colour, border))
     if not data then
         return nil
     end
     return { _type = "PTImage", ptr = data }
 end
 
+--- Text layout structure.
+-- Can be used anywhere a @{PTImage} is drawn, but skips making an image;
+-- each glyph is copied straight from the font to the screen.
+-- Flip flags are ignored.
+-- @tfield string _type "PTTextLayout"
+-- @tfield userdata ptr Pointer to C data.
+-- @tfield PTFont font Font used by the layout.
+-- @tfield integer width Width of the laid out text.
+-- @tfield integer height Height of the laid out text.
+-- @tfield integer length Number of glyphs in the text, not counting whitespace.
+-- @tfield integer reveal Number of glyphs to draw, or nil to draw them all. See @{PTSetTextReveal}.
+-- @table PTTextLayout
+
+--- Lay out text for drawing directly to the screen.
+-- Cheaper than @{PTText} for text that changes often, as no image is
+-- rendered or cached.
+-- @tparam string text Unicode text to render.
+-- @tparam PTFont font Font object to use.
+-- @tparam[opt=200] integer width Width of bounding area in pixels.
+-- @tparam[opt="left"] string align Text alignment; one of "left", "center" or "right".
+-- @tparam[opt={ 0xff 0xff 0xff }] table colour Inner colour; list of 3 8-bit numbers.
+-- @tparam[opt={ 0x00 0x00 0x00 }] table border Border colour; list of 3 8-bit numbers.
+-- @treturn PTTextLayout The new layout, or nil if the text was unable to be laid out.
+PTTextLayout = function(text, font, width, align, colour, border)
+    local data, w, h, length = _PTTextLayout(text, font.ptr, _PTTextArgs(width, align, colour, border))
+    if not data then
+        return nil
+    end
+    return { _type = "PTTextLayout", ptr = data, font = font, width = w, height = h, length = length }
+end
+
+--- Set how much of a text layout to draw.
+-- Glyphs are drawn in reading order, so increasing the count over time
+-- reveals the text like a typewriter. The layout is the same size
+-- no matter how much of it is revealed.
+-- Lowering the count is cheap, except for text in dithered colours, where
+-- the revealed part has to be rendered again.
+-- @tparam PTTextLayout layout Text layout to change.
+-- @tparam integer count Number of glyphs to draw, not counting whitespace; nil or negative to draw them all.
+PTSetTextReveal = function(layout, count)
+    if not layout or layout._type ~= "PTTextLayout" then
+        return
+    end
+    layout.reveal = count
+end
+
+--- Set the memory budget for the text image cache.
+-- Rendering the same text with the same font, width, alignment and colours
+-- as a recent call to @{PTText} returns the cached image instead of drawing a new one.
+-- The least recently used images are dropped once the budget is used up.
+-- @tparam integer budget Size of the cache, in bytes of image data. Defaults to 65536; 0 disables the cache.
+PTSetTextCacheBudget = function(budget)
+    _PTSetTextCacheBudget(budget)
+end
+
 --- Audio
 -- @section audio
 
@@ -4066,9 +4164,7 @@ PTRoomAddObject = function(room, object)
     if object then
         _PTAddToList(room.render_list, object)
     end
-    table.sort(room.render_list, function(a, b)
-        return a.z < b.z
-    end)
+    _PTSortByDepth(room.render_list)
 end
 
 --- Remove a renderable (@{PTActor}/@{PTBackground}/@{PTSprite}/@{PTGroup}) object from the room rendering list.
@@ -4081,9 +4177,7 @@ PTRoomRemoveObject = function(room, object)
     if object then
         _PTRemoveFromList(room.render_list, object)
     end
-    table.sort(room.render_list, function(a, b)
-        return a.z < b.z
-    end)
+    _PTSortByDepth(room.render_list)
 end
 
 --- Update the depth ordering of the objects in the room.
@@ -4093,9 +4187,7 @@ PTRoomUpdateDepth = function(room)
     if not room or room._type ~= "PTRoom" then
         error("PTRoomUpdateDepth: expected PTRoom for first argument")
     end
-    table.sort(room.render_list, function(a, b)
-        return a.z < b.z
-    end)
+    _PTSortByDepth(room.render_list)
 end
 
 --- Set the walk boxes for a room.
@@ -4791,10 +4883,27 @@ _PTRender = function()
     end
     local debugBuffer = {}
 
+    -- Queue up plain images, so they can be sent to the engine in one go
+    local batch = {}
+    local flush = function()
+        if #batch > 0 then
+            _PTDrawImages(batch)
+            batch = {}
+        end
+    end
     local blit = function(img, x, y, flags)
         x, y = math.floor(x), math.floor(y)
         if img then
-            PTDrawImage(img, x, y, flags)
+            if img._type == "PTImage" then
+                local n = #batch
+                batch[n + 1] = img.ptr
+                batch[n + 2] = x
+                batch[n + 3] = y
+                batch[n + 4] = flags
+            else
+                flush()
+                PTDrawImage(img, x, y, flags)
+            end
             if _PTImageDebug then
                 local w, h = PTGetImageDims(img)
                 local ox, oy = PTGetImageOrigin(img)
@@ -4803,13 +4912,19 @@ _PTRender = function()
         end
     end
 
-    for obj, x, y in PTIterObjects(room.render_list) do
-        local frame, flags = PTGetImageFromObject(obj)
-        if frame then
-            local tmp_x, tmp_y = PTRoomToScreen(x, y, obj.parallax_x, obj.parallax_y)
-            blit(frame, tmp_x, tmp_y, flags)
+    if _PTImageDebug then
+        for obj, x, y in PTIterObjects(room.render_list) do
+            local frame, flags = PTGetImageFromObject(obj)
+            if frame then
+                local tmp_x, tmp_y = PTRoomToScreen(x, y, obj.parallax_x, obj.parallax_y)
+                blit(frame, tmp_x, tmp_y, flags)
+            end
         end
+    else
+        -- Fast path; the engine keeps a copy of the scene and draws it directly
+        _PTSceneRender(0, room.render_list, _PTRenderRevision, room)
     end
+    flush()
     if _PTWalkBoxDebug then
         for i, box in pairs(room.boxes) do
             local ul_x, ul_y = PTRoomToScreen(box.ul.x, box.ul.y)
@@ -4822,22 +4937,28 @@ _PTRender = function()
             _PTDrawLine(ll_x, ll_y, ul_x, ul_y, 0xff, 0x55, 0x55)
         end
     end
-    for obj, x, y in PTIterObjects(_PTGlobalRenderList) do
-        local frame, flags = PTGetImageFromObject(obj)
-        if frame then
-            blit(frame, x, y, flags)
+    if _PTImageDebug then
+        for obj, x, y in PTIterObjects(_PTGlobalRenderList) do
+            local frame, flags = PTGetImageFromObject(obj)
+            if frame then
+                blit(frame, x, y, flags)
+            end
         end
-    end
-    for _, panel in ipairs(_PTPanelList) do
-        if panel.visible then
-            for obj, x, y in PTIterObjects({ panel }) do
-                local frame, flags = PTGetImageFromObject(obj)
-                if frame then
-                    blit(frame, x, y, flags)
+        for _, panel in ipairs(_PTPanelList) do
+            if panel.visible then
+                for obj, x, y in PTIterObjects({ panel }) do
+                    local frame, flags = PTGetImageFromObject(obj)
+                    if frame then
+                        blit(frame, x, y, flags)
+                    end
                 end
             end
         end
+    else
+        _PTSceneRender(1, _PTGlobalRenderList, _PTRenderRevision)
+        _PTSceneRender(2, _PTPanelList, _PTRenderRevision)
     end
+    flush()
 
     if _PTImageDebug then
         for _, t in pairs(debugBuffer) do
@@ -4856,8 +4977,13 @@ _PTRender = function()
         for obj, x, y in PTIterObjects({ _PTMouseSprite }) do
             local frame, flags = PTGetImageFromObject(obj)
             if frame then
-                _PTDrawImage(frame.ptr, mouse_x, mouse_y, flags)
+                local n = #batch
+                batch[n + 1] = frame.ptr
+                batch[n + 2] = mouse_x
+                batch[n + 3] = mouse_y
+                batch[n + 4] = flags
             end
         end
+        flush()
     end
 end
@@ -2,6 +2,12 @@
 #include <stdint.h>
 #include <string.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #include "colour.h"
 #include "log.h"
 #include "system.h"
@@ -26,69 +32,6 @@ pt_colour_rgb ega_palette[] = {
 };
 
 // clang-format off
-// Block a bunch of auto-dithering combinations which look bad.
-uint8_t ega_banned_dithering[] = {
-    // Black should only be mixed with dark-range colours
-    EGA_BLACK, EGA_LGRAY,
-    EGA_BLACK, EGA_BRBLUE,
-    EGA_BLACK, EGA_BRGREEN,
-    EGA_BLACK, EGA_BRCYAN,
-    EGA_BLACK, EGA_BRRED,
-    EGA_BLACK, EGA_BRMAGENTA,
-    EGA_BLACK, EGA_BRYELLOW,
-    // White should only be mixed with light-range colours
-    EGA_BLACK, EGA_WHITE,
-    EGA_BLUE, EGA_WHITE,
-    EGA_GREEN, EGA_WHITE,
-    EGA_CYAN, EGA_WHITE,
-    EGA_RED, EGA_WHITE,
-    EGA_MAGENTA, EGA_WHITE,
-    EGA_BROWN, EGA_WHITE,
-    EGA_DGRAY, EGA_WHITE,
-    // Dark blue
-    EGA_BLUE, EGA_GREEN,
-    EGA_BLUE, EGA_RED,
-    EGA_BLUE, EGA_BRGREEN,
-    EGA_BLUE, EGA_BRRED,
-    EGA_BLUE, EGA_BRYELLOW,
-    // Dark green
-    EGA_GREEN, EGA_RED,
-    EGA_GREEN, EGA_MAGENTA,
-    EGA_GREEN, EGA_BRRED,
-    EGA_GREEN, EGA_BRMAGENTA,
-    // Dark cyan
-    EGA_CYAN, EGA_RED,
-    EGA_CYAN, EGA_MAGENTA,
-    EGA_CYAN, EGA_BROWN,
-    EGA_CYAN, EGA_BRRED,
-    EGA_CYAN, EGA_BRMAGENTA,
-    EGA_CYAN, EGA_BRYELLOW,
-    // Dark red
-    EGA_RED, EGA_BRBLUE,
-    EGA_RED, EGA_BRGREEN,
-    EGA_RED, EGA_BRCYAN,
-    // Dark magenta
-    EGA_MAGENTA, EGA_BROWN,
-    EGA_MAGENTA, EGA_BRGREEN,
-    EGA_MAGENTA, EGA_BRCYAN,
-    //EGA_MAGENTA, EGA_BRYELLOW,
-    // Brown
-    EGA_BROWN, EGA_BRBLUE,
-    EGA_BROWN, EGA_BRGREEN,
-    EGA_BROWN, EGA_BRCYAN,
-    EGA_BROWN, EGA_BRMAGENTA,
-    // Bright blue
-    //EGA_BRBLUE, EGA_BRGREEN,
-    EGA_BRBLUE, EGA_BRRED,
-    EGA_BRBLUE, EGA_BRYELLOW,
-    // Bright green
-    EGA_BRGREEN, EGA_BRRED,
-    EGA_BRGREEN, EGA_BRMAGENTA,
-    // Bright cyan
-    EGA_BRCYAN, EGA_BRRED,
-    EGA_BRCYAN, EGA_BRMAGENTA,
-};
-
 // CGA autodithering is very basic. For each of the six modes,
 // we have a lookup table that converts EGA to one of the CGA colours.
 // This allows people to write one set of hints for EGA and recycle
@@ -208,10 +151,25 @@ uint8_t cga2b_from_ega[] = {
 };
 // clang-format on
 
-static bool dither_tables_init = false;
-static pt_colour_oklab ega_oklab[16] = { 0 };
-static pt_colour_oklab ega_dither_half[256] = { 0 };
-static pt_colour_oklab ega_dither_quarter[256] = { 0 };
+// ega_oklab, ega_dither_half and ega_dither_quarter; see dithertables.lua
+#include "dither_tables.h"
+
+// Results of the OKLab searches in get_ega_dither_for_colour.
+// The tables never change, so neither do the results.
+#define DITHER_CACHE_SIZE 512
+
+typedef struct pt_dither_cache pt_dither_cache;
+struct pt_dither_cache {
+    // RGB colour, with bit 24 set if the entry is filled
+    uint32_t key;
+    pt_colour_oklab oklab;
+    uint8_t nearest;
+    uint8_t half_nearest;
+    uint8_t quarter_nearest;
+    bool quarter_better;
+};
+
+static pt_dither_cache dither_cache[DITHER_CACHE_SIZE] = { 0 };
 
 float clampf(float d, float min, float max)
 {
@@ -273,75 +231,160 @@ void oklab_colour_blend(pt_colour_oklab* a, pt_colour_oklab* b, float alpha, pt_
     return;
 }
 
-float oklab_luma_distance(pt_colour_oklab* a, pt_colour_oklab* b)
+float oklab_luma_distance(const pt_colour_oklab* a, const pt_colour_oklab* b)
 {
     return (b->L - a->L) * (b->L - a->L);
 }
 
-float oklab_chroma_distance(pt_colour_oklab* a, pt_colour_oklab* b)
+float oklab_chroma_distance(const pt_colour_oklab* a, const pt_colour_oklab* b)
 {
     return (b->a - a->a) * (b->a - a->a) + (b->b - a->b) * (b->b - a->b);
 }
 
-float oklab_distance(pt_colour_oklab* a, pt_colour_oklab* b)
+float oklab_distance(const pt_colour_oklab* a, const pt_colour_oklab* b)
 {
     return oklab_luma_distance(a, b) + oklab_chroma_distance(a, b);
 }
 
-pt_colour_oklab* oklab_nearest(pt_colour_oklab* src, pt_colour_oklab* a, pt_colour_oklab* b)
+const pt_colour_oklab* oklab_nearest(const pt_colour_oklab* src, const pt_colour_oklab* a, const pt_colour_oklab* b)
 {
     return oklab_distance(src, a) < oklab_distance(src, b) ? a : b;
 }
 
-pt_colour_oklab* oklab_nearest_luma(pt_colour_oklab* src, pt_colour_oklab* a, pt_colour_oklab* b)
+const pt_colour_oklab* oklab_nearest_luma(
+    const pt_colour_oklab* src, const pt_colour_oklab* a, const pt_colour_oklab* b)
 {
     return oklab_luma_distance(src, a) < oklab_luma_distance(src, b) ? a : b;
 }
 
-pt_colour_oklab* oklab_nearest_chroma(pt_colour_oklab* src, pt_colour_oklab* a, pt_colour_oklab* b)
+const pt_colour_oklab* oklab_nearest_chroma(
+    const pt_colour_oklab* src, const pt_colour_oklab* a, const pt_colour_oklab* b)
 {
     return oklab_chroma_distance(src, a) < oklab_chroma_distance(src, b) ? a : b;
 }
 
-void generate_dither_tables()
+// Find the entry in an OKLab table nearest to src, one entry at a time.
+// Kept as the reference for oklab_table_nearest.
+int oklab_table_nearest_scalar(const pt_colour_oklab* src, const pt_colour_oklab* table, int count, float* dist)
 {
-    if (dither_tables_init)
-        return;
+    int result = 0;
+    float result_val = oklab_distance(src, &table[0]);
+    for (int i = 1; i < count; i++) {
+        float new_val = oklab_distance(src, &table[i]);
+        if (new_val < result_val) {
+            result_val = new_val;
+            result = i;
+        }
+    }
+    *dist = result_val;
+    return result;
+}
 
-    for (int i = 0; i < 16; i++) {
-        rgb8_to_oklab(&ega_palette[i], &ega_oklab[i]);
+// Find the entry in an OKLab table nearest to src, using the planar copy of the
+// table (see dithertables.lua). count must be a multiple of 4.
+// Ties go to the lowest index, same as oklab_table_nearest_scalar.
+int oklab_table_nearest(const pt_colour_oklab* src, const float* planes, int count, float* dist)
+{
+    const float* L = planes;
+    const float* a = planes + count;
+    const float* b = planes + 2 * count;
+    float best_val[4];
+    int32_t best_idx[4];
+
+#if defined(__SSE2__)
+    __m128 src_L = _mm_set1_ps(src->L);
+    __m128 src_a = _mm_set1_ps(src->a);
+    __m128 src_b = _mm_set1_ps(src->b);
+    __m128 best = _mm_set1_ps(INFINITY);
+    __m128i best_i = _mm_setzero_si128();
+    __m128i idx = _mm_set_epi32(3, 2, 1, 0);
+    __m128i step = _mm_set1_epi32(4);
+    for (int i = 0; i < count; i += 4) {
+        __m128 dL = _mm_sub_ps(_mm_loadu_ps(L + i), src_L);
+        __m128 da = _mm_sub_ps(_mm_loadu_ps(a + i), src_a);
+        __m128 db = _mm_sub_ps(_mm_loadu_ps(b + i), src_b);
+        __m128 d = _mm_add_ps(_mm_mul_ps(dL, dL), _mm_add_ps(_mm_mul_ps(da, da), _mm_mul_ps(db, db)));
+        __m128 lt = _mm_cmplt_ps(d, best);
+        best = _mm_or_ps(_mm_and_ps(lt, d), _mm_andnot_ps(lt, best));
+        __m128i lt_i = _mm_castps_si128(lt);
+        best_i = _mm_or_si128(_mm_and_si128(lt_i, idx), _mm_andnot_si128(lt_i, best_i));
+        idx = _mm_add_epi32(idx, step);
     }
-    for (int i = 0; i < 256; i++) {
-        oklab_colour_blend(&ega_oklab[i / 16], &ega_oklab[i % 16], 0.5f, &ega_dither_half[i]);
-        oklab_colour_blend(&ega_oklab[i / 16], &ega_oklab[i % 16], 0.75f, &ega_dither_quarter[i]);
-    }
-    // erase a bunch of combinations which look bad.
-    for (int i = 0; i < (sizeof(ega_banned_dithering) >> 1); i++) {
-        int a = ega_banned_dithering[i << 1];
-        int b = ega_banned_dithering[(i << 1) + 1];
-        ega_dither_half[b * 16 + a].L = ega_oklab[0].L;
-        ega_dither_half[b * 16 + a].a = ega_oklab[0].a;
-        ega_dither_half[b * 16 + a].b = ega_oklab[0].b;
-        ega_dither_half[a * 16 + b].L = ega_oklab[0].L;
-        ega_dither_half[a * 16 + b].a = ega_oklab[0].a;
-        ega_dither_half[a * 16 + b].b = ega_oklab[0].b;
-        ega_dither_quarter[b * 16 + a].L = ega_oklab[0].L;
-        ega_dither_quarter[b * 16 + a].a = ega_oklab[0].a;
-        ega_dither_quarter[b * 16 + a].b = ega_oklab[0].b;
-        ega_dither_quarter[a * 16 + b].L = ega_oklab[0].L;
-        ega_dither_quarter[a * 16 + b].a = ega_oklab[0].a;
-        ega_dither_quarter[a * 16 + b].b = ega_oklab[0].b;
-    }
-
-    dither_tables_init = true;
-    return;
+    _mm_storeu_ps(best_val, best);
+    _mm_storeu_si128((__m128i*)best_idx, best_i);
+#elif defined(__ARM_NEON)
+    float32x4_t src_L = vdupq_n_f32(src->L);
+    float32x4_t src_a = vdupq_n_f32(src->a);
+    float32x4_t src_b = vdupq_n_f32(src->b);
+    float32x4_t best = vdupq_n_f32(INFINITY);
+    int32x4_t best_i = vdupq_n_s32(0);
+    static const int32_t lanes[4] = { 0, 1, 2, 3 };
+    int32x4_t idx = vld1q_s32(lanes);
+    int32x4_t step = vdupq_n_s32(4);
+    for (int i = 0; i < count; i += 4) {
+        float32x4_t dL = vsubq_f32(vld1q_f32(L + i), src_L);
+        float32x4_t da = vsubq_f32(vld1q_f32(a + i), src_a);
+        float32x4_t db = vsubq_f32(vld1q_f32(b + i), src_b);
+        float32x4_t d = vaddq_f32(vmulq_f32(dL, dL), vaddq_f32(vmulq_f32(da, da), vmulq_f32(db, db)));
+        uint32x4_t lt = vcltq_f32(d, best);
+        best = vbslq_f32(lt, d, best);
+        best_i = vbslq_s32(lt, idx, best_i);
+        idx = vaddq_s32(idx, step);
+    }
+    vst1q_f32(best_val, best);
+    vst1q_s32(best_idx, best_i);
+#else
+    for (int j = 0; j < 4; j++) {
+        best_val[j] = INFINITY;
+        best_idx[j] = 0;
+    }
+    for (int i = 0; i < count; i += 4) {
+        for (int j = 0; j < 4; j++) {
+            float dL = L[i + j] - src->L;
+            float da = a[i + j] - src->a;
+            float db = b[i + j] - src->b;
+            float d = dL * dL + (da * da + db * db);
+            if (d < best_val[j]) {
+                best_val[j] = d;
+                best_idx[j] = i + j;
+            }
+        }
+    }
+#endif
+
+    // Each lane has the first of its nearest entries; pick between them
+    int result = best_idx[0];
+    float result_val = best_val[0];
+    for (int j = 1; j < 4; j++) {
+        if ((best_val[j] < result_val) || ((best_val[j] == result_val) && (best_idx[j] < result))) {
+            result = best_idx[j];
+            result_val = best_val[j];
+        }
+    }
+    *dist = result_val;
+    return result;
+}
+
+static pt_dither_cache* dither_cache_lookup(pt_colour_rgb* src)
+{
+    uint32_t key = (1 << 24) | (src->r << 16) | (src->g << 8) | src->b;
+    pt_dither_cache* entry = &dither_cache[((key * 2654435761u) >> 16) % DITHER_CACHE_SIZE];
+    if (entry->key == key)
+        return entry;
+
+    entry->key = key;
+    rgb8_to_oklab(src, &entry->oklab);
+
+    float nearest_val, half_nearest_val, quarter_nearest_val;
+    entry->nearest = oklab_table_nearest(&entry->oklab, ega_oklab_planes, 16, &nearest_val);
+    entry->half_nearest = oklab_table_nearest(&entry->oklab, ega_dither_half_planes, 256, &half_nearest_val);
+    entry->quarter_nearest = oklab_table_nearest(&entry->oklab, ega_dither_quarter_planes, 256, &quarter_nearest_val);
+    entry->quarter_better = quarter_nearest_val < half_nearest_val;
+    return entry;
 }
 
 void get_ega_dither_for_colour(enum pt_palette_remapper_mode mode, pt_colour_rgb* src, pt_dither* dest)
 {
-    if (!dither_tables_init) {
-        generate_dither_tables();
-    }
     uint8_t src_col = map_colour(src->r, src->g, src->b);
     if (src_col < 16) {
         dest->type = DITHER_FILL_A;
@@ -350,41 +393,24 @@ void get_ega_dither_for_colour(enum pt_palette_remapper_mode mode, pt_colour_rgb
         return;
     }
 
-    pt_colour_oklab src_oklab = { 0 };
-    rgb8_to_oklab(src, &src_oklab);
+    pt_dither_cache* entry = dither_cache_lookup(src);
+    pt_colour_oklab* src_oklab = &entry->oklab;
 
     if (mode == REMAPPER_MODE_NEAREST) {
-        int nearest = 0;
-        float nearest_val = oklab_distance(&src_oklab, &ega_oklab[0]);
-        for (int i = 1; i < 16; i++) {
-            float new_val = oklab_distance(&src_oklab, &ega_oklab[i]);
-            if (new_val < nearest_val) {
-                nearest_val = new_val;
-                nearest = i;
-            }
-        }
         dest->type = DITHER_FILL_A;
-        dest->idx_a = nearest;
+        dest->idx_a = entry->nearest;
         dest->idx_b = 0;
         return;
     }
 
-    int half_nearest = 0;
-    float half_nearest_val = oklab_distance(&src_oklab, &ega_dither_half[0]);
-    for (int i = 1; i < 256; i++) {
-        float new_val = oklab_distance(&src_oklab, &ega_dither_half[i]);
-        if (new_val < half_nearest_val) {
-            half_nearest_val = new_val;
-            half_nearest = i;
-        }
-    }
+    int half_nearest = entry->half_nearest;
     if (mode == REMAPPER_MODE_HALF) {
         dest->type = DITHER_HALF;
         dest->idx_a = half_nearest / 16;
         dest->idx_b = half_nearest % 16;
         return;
     } else if (mode == REMAPPER_MODE_HALF_NEAREST) {
-        dest->type = oklab_nearest(&src_oklab, &ega_dither_half[dest->idx_a], &ega_dither_half[dest->idx_b])
+        dest->type = oklab_nearest(src_oklab, &ega_dither_half[dest->idx_a], &ega_dither_half[dest->idx_b])
                 == &ega_dither_half[dest->idx_a]
             ? DITHER_FILL_A
             : DITHER_FILL_B;
@@ -393,17 +419,8 @@ void get_ega_dither_for_colour(enum pt_palette_remapper_mode mode, pt_colour_rgb
         return;
     }
 
-    int quarter_nearest = 0;
-    float quarter_nearest_val = oklab_distance(&src_oklab, &ega_dither_quarter[0]);
-    for (int i = 1; i < 256; i++) {
-        float new_val = oklab_distance(&src_oklab, &ega_dither_quarter[i]);
-        if (new_val < quarter_nearest_val) {
-            quarter_nearest_val = new_val;
-            quarter_nearest = i;
-        }
-    }
-
-    if (quarter_nearest_val < half_nearest_val) {
+    int quarter_nearest = entry->quarter_nearest;
+    if (entry->quarter_better) {
         dest->idx_a = quarter_nearest / 16;
         dest->idx_b = quarter_nearest % 16;
         if (mode == REMAPPER_MODE_QUARTER) {
@@ -411,7 +428,7 @@ void get_ega_dither_for_colour(enum pt_palette_remapper_mode mode, pt_colour_rgb
         } else if (mode == REMAPPER_MODE_QUARTER_ALT) {
             dest->type = DITHER_QUARTER_ALT;
         } else if (mode == REMAPPER_MODE_QUARTER_NEAREST) {
-            dest->type = oklab_nearest(&src_oklab, &ega_dither_quarter[dest->idx_a], &ega_dither_quarter[dest->idx_b])
+            dest->type = oklab_nearest(src_oklab, &ega_dither_quarter[dest->idx_a], &ega_dither_quarter[dest->idx_b])
                     == &ega_dither_quarter[dest->idx_a]
                 ? DITHER_FILL_A
                 : DITHER_FILL_B;
@@ -423,7 +440,7 @@ void get_ega_dither_for_colour(enum pt_palette_remapper_mode mode, pt_colour_rgb
         if (mode == REMAPPER_MODE_QUARTER || mode == REMAPPER_MODE_QUARTER_ALT) {
             dest->type = DITHER_HALF;
         } else if (mode == REMAPPER_MODE_QUARTER_NEAREST) {
-            dest->type = oklab_nearest(&src_oklab, &ega_dither_half[dest->idx_a], &ega_dither_half[dest->idx_b])
+            dest->type = oklab_nearest(src_oklab, &ega_dither_half[dest->idx_a], &ega_dither_half[dest->idx_b])
                     == &ega_dither_half[dest->idx_a]
                 ? DITHER_FILL_A
                 : DITHER_FILL_B;
@@ -484,12 +501,203 @@ void set_dither_from_remapper(
     //     pt_sys.palette[idx].g, pt_sys.palette[idx].b, dest->type, dest->idx_a, dest->idx_b);
 }
 
-uint8_t map_colour(uint8_t r, uint8_t g, uint8_t b)
+// Palette effects
+
+typedef struct pt_palette_cycle pt_palette_cycle;
+struct pt_palette_cycle {
+    uint32_t id;
+    uint8_t slots[PALETTE_CYCLE_LENGTH];
+    int count;
+    uint32_t delay;
+    bool reverse;
+    uint32_t start;
+    // Number of steps the colours have moved along, modulo count
+    int offset;
+};
+
+static pt_palette_cycle palette_cycles[PALETTE_CYCLE_MAX];
+static int palette_cycle_count = 0;
+static uint32_t palette_cycle_max_id = 0;
+
+static pt_colour_rgb fade_colour = { 0x00, 0x00, 0x00 };
+static float fade_from = 0.0f;
+static float fade_to = 0.0f;
+static float fade_amount = 0.0f;
+static uint32_t fade_start = 0;
+static uint32_t fade_duration = 0;
+static bool fade_pending = false;
+
+// Set when the displayed palette might differ from pt_sys.palette
+static bool effects_active = false;
+
+static uint32_t palette_millis()
+{
+    return pt_sys.timer ? pt_sys.timer->millis() : 0;
+}
+
+static void palette_effect_colour(uint8_t idx, pt_colour_rgb* dest)
+{
+    pt_colour_rgb* src = &pt_sys.palette[idx];
+    for (int i = 0; i < palette_cycle_count; i++) {
+        pt_palette_cycle* cycle = &palette_cycles[i];
+        for (int j = 0; j < cycle->count; j++) {
+            if (cycle->slots[j] != idx)
+                continue;
+            // Forward cycles move colours towards the end of the list
+            int k = cycle->reverse ? (j + cycle->offset) : (j - cycle->offset + cycle->count);
+            src = &pt_sys.palette[cycle->slots[k % cycle->count]];
+            break;
+        }
+    }
+    if (fade_amount <= 0.0f) {
+        *dest = *src;
+        return;
+    }
+    dest->r = (byte)(src->r + (fade_colour.r - src->r) * fade_amount + 0.5f);
+    dest->g = (byte)(src->g + (fade_colour.g - src->g) * fade_amount + 0.5f);
+    dest->b = (byte)(src->b + (fade_colour.b - src->b) * fade_amount + 0.5f);
+}
+
+uint32_t palette_cycle_add(uint8_t* slots, int count, uint32_t delay, bool reverse)
+{
+    if (palette_cycle_count >= PALETTE_CYCLE_MAX) {
+        log_print("palette_cycle_add: too many palette cycles\n");
+        return 0;
+    }
+    if ((count < 2) || (count > PALETTE_CYCLE_LENGTH) || (delay == 0)) {
+        log_print("palette_cycle_add: invalid cycle (%d colours, %d ms)\n", count, delay);
+        return 0;
+    }
+    pt_palette_cycle* cycle = &palette_cycles[palette_cycle_count];
+    palette_cycle_max_id++;
+    cycle->id = palette_cycle_max_id;
+    memcpy(cycle->slots, slots, count);
+    cycle->count = count;
+    cycle->delay = delay;
+    cycle->reverse = reverse;
+    cycle->start = palette_millis();
+    cycle->offset = 0;
+    palette_cycle_count++;
+    effects_active = true;
+    return cycle->id;
+}
+
+bool palette_cycle_remove(uint32_t id)
 {
+    for (int i = 0; i < palette_cycle_count; i++) {
+        if (palette_cycles[i].id == id) {
+            palette_cycle_count--;
+            if (i != palette_cycle_count)
+                palette_cycles[i] = palette_cycles[palette_cycle_count];
+            // One more update is needed to put the colours back
+            effects_active = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+void palette_fade(pt_colour_rgb* colour, float amount, uint32_t duration)
+{
+    if (colour)
+        fade_colour = *colour;
+    fade_from = fade_amount;
+    fade_to = amount < 0.0f ? 0.0f : (amount > 1.0f ? 1.0f : amount);
+    fade_start = palette_millis();
+    fade_duration = duration;
+    fade_pending = true;
+    effects_active = true;
+}
+
+bool palette_is_fading()
+{
+    return fade_pending;
+}
+
+void palette_update_effects(uint32_t millis)
+{
+    if (!effects_active)
+        return;
+
+    for (int i = 0; i < palette_cycle_count; i++) {
+        pt_palette_cycle* cycle = &palette_cycles[i];
+        cycle->offset = ((millis - cycle->start) / cycle->delay) % cycle->count;
+    }
+    if (fade_pending) {
+        uint32_t elapsed = millis - fade_start;
+        if (elapsed >= fade_duration) {
+            fade_amount = fade_to;
+            fade_pending = false;
+        } else {
+            fade_amount = fade_from + (fade_to - fade_from) * ((float)elapsed / fade_duration);
+        }
+    }
+
+    // Only tell the video driver about the slots which have changed
     for (int i = 0; i < pt_sys.palette_top; i++) {
-        if (pt_sys.palette[i].r == r && pt_sys.palette[i].g == g && pt_sys.palette[i].b == b)
-            return i;
+        pt_colour_rgb colour;
+        palette_effect_colour(i, &colour);
+        pt_colour_rgb* dest = &pt_sys.palette_display[i];
+        if ((colour.r != dest->r) || (colour.g != dest->g) || (colour.b != dest->b)) {
+            *dest = colour;
+            pt_sys.video->update_palette_slot(i);
+        }
     }
+
+    effects_active = palette_cycle_count || fade_pending || (fade_amount > 0.0f);
+}
+
+// Palette lookup; open addressed hash table from RGB to palette slot.
+// There are never more than 255 colours, so it's at most half full.
+#define PALETTE_HASH_SIZE 512
+
+// Palette slot + 1, or 0 if empty
+static uint16_t palette_hash[PALETTE_HASH_SIZE] = { 0 };
+
+// Nearest palette slot + 1 for each 5-bit RGB cell, or 0 if not looked up yet
+static uint8_t nearest_cache[32 * 32 * 32] = { 0 };
+
+// Dither pattern for each palette slot, 4 pixels wide and 2 high.
+// The patterns in dither_calc all repeat within that.
+static uint8_t dither_tiles[256][8] = { 0 };
+
+static void dither_update_tile(uint8_t idx);
+
+static inline uint32_t palette_hash_start(uint8_t r, uint8_t g, uint8_t b)
+{
+    uint32_t key = ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+    return (key * 2654435761u) >> 23;
+}
+
+static int palette_hash_find(uint8_t r, uint8_t g, uint8_t b)
+{
+    uint32_t i = palette_hash_start(r, g, b);
+    while (palette_hash[i]) {
+        pt_colour_rgb* c = &pt_sys.palette[palette_hash[i] - 1];
+        if (c->r == r && c->g == g && c->b == b)
+            return palette_hash[i] - 1;
+        i = (i + 1) % PALETTE_HASH_SIZE;
+    }
+    return -1;
+}
+
+static void palette_hash_add(uint8_t idx)
+{
+    pt_colour_rgb* c = &pt_sys.palette[idx];
+    // Keep the lowest slot if a colour appears more than once
+    if (palette_hash_find(c->r, c->g, c->b) >= 0)
+        return;
+    uint32_t i = palette_hash_start(c->r, c->g, c->b);
+    while (palette_hash[i])
+        i = (i + 1) % PALETTE_HASH_SIZE;
+    palette_hash[i] = idx + 1;
+}
+
+uint8_t map_colour(uint8_t r, uint8_t g, uint8_t b)
+{
+    int found = palette_hash_find(r, g, b);
+    if (found >= 0)
+        return found;
     // add a new colour
     if (pt_sys.palette_top < 255) {
         int idx = pt_sys.palette_top;
@@ -497,12 +705,24 @@ uint8_t map_colour(uint8_t r, uint8_t g, uint8_t b)
         pt_sys.palette[idx].r = r;
         pt_sys.palette[idx].g = g;
         pt_sys.palette[idx].b = b;
+        palette_hash_add(idx);
+        palette_effect_colour(idx, &pt_sys.palette_display[idx]);
         set_dither_from_remapper(pt_sys.remapper, pt_sys.remapper_mode, idx, &pt_sys.dither[idx]);
+        dither_update_tile(idx);
+        // Nothing can be using the new slot yet, so no images need to be reconverted
         pt_sys.video->update_palette_slot(idx);
-        pt_sys.palette_revision++;
         return idx;
     }
     // Out of palette slots; need to macguyver the nearest colour.
+    // The palette can't change again until palette_init, so the results
+    // are cached per 5-bit RGB cell.
+    uint16_t cell = ((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3);
+    if (nearest_cache[cell])
+        return nearest_cache[cell] - 1;
+    r = (r & 0xf8) | (r >> 5);
+    g = (g & 0xf8) | (g >> 5);
+    b = (b & 0xf8) | (b >> 5);
+
     // Formula borrowed from ScummVM's palette code.
     uint8_t best_colour = 0;
     uint32_t min = 0xffffffff;
@@ -518,6 +738,7 @@ uint8_t map_colour(uint8_t r, uint8_t g, uint8_t b)
             min = dist_squared;
         }
     }
+    nearest_cache[cell] = best_colour + 1;
     return best_colour;
 }
 
@@ -567,8 +788,9 @@ void dither_set_hint(pt_colour_rgb* src, enum pt_dither_type type, pt_colour_rgb
     pt_sys.dither[idx_src].type = type;
     pt_sys.dither[idx_src].idx_a = idx_a;
     pt_sys.dither[idx_src].idx_b = idx_b;
+    dither_update_tile(idx_src);
 
-    pt_sys.palette_revision++;
+    palette_touch_slot(idx_src);
 }
 
 uint8_t dither_calc(uint8_t src, int16_t x, int16_t y)
@@ -591,6 +813,22 @@ uint8_t dither_calc(uint8_t src, int16_t x, int16_t y)
     }
 }
 
+static void dither_update_tile(uint8_t idx)
+{
+    for (int i = 0; i < 8; i++) {
+        dither_tiles[idx][i] = dither_calc(idx, i & 3, i >> 2);
+    }
+}
+
+void dither_build_map(const uint8_t* palette_map, pt_dither_map* dest)
+{
+    for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 256; j++) {
+            dest->phase[i][j] = dither_tiles[palette_map[j]][i];
+        }
+    }
+}
+
 void palette_init()
 {
     // Fill the top 16 colours with the EGA palette.
@@ -601,10 +839,84 @@ void palette_init()
         pt_sys.palette[i].b = ega_palette[i].b;
     }
     pt_sys.palette_top = 16;
-    pt_sys.palette_revision = 0;
+    pt_sys.palette_epoch++;
+    // Every slot is up for grabs again, so anything converted before now is stale
+    pt_sys.palette_revision++;
+    for (int i = 0; i < 256; i++) {
+        pt_sys.slot_revision[i] = pt_sys.palette_revision;
+    }
     memset(&pt_sys.palette[16], 0, sizeof(pt_colour_rgb) * 240);
+    memcpy(pt_sys.palette_display, pt_sys.palette, sizeof(pt_colour_rgb) * 256);
+    memset(palette_hash, 0, sizeof(palette_hash));
+    memset(nearest_cache, 0, sizeof(nearest_cache));
+    for (int i = 0; i < pt_sys.palette_top; i++) {
+        palette_hash_add(i);
+    }
+
+    // Put back any of the EGA colours which were changed by palette effects
+    if (effects_active) {
+        for (int i = 0; i < 16; i++) {
+            pt_sys.video->update_palette_slot(i);
+        }
+    }
+    palette_cycle_count = 0;
+    fade_amount = 0.0f;
+    fade_pending = false;
+    effects_active = false;
 
     pt_sys.remapper = REMAPPER_NONE;
     pt_sys.remapper_mode = REMAPPER_MODE_NEAREST;
     memset(pt_sys.dither, 0, sizeof(pt_dither) * 256);
+    for (int i = 0; i < 256; i++) {
+        dither_update_tile(i);
+    }
+}
+
+void palette_set_remapper(enum pt_palette_remapper remapper, enum pt_palette_remapper_mode mode)
+{
+    pt_sys.remapper = remapper;
+    pt_sys.remapper_mode = mode;
+    for (int i = 0; i < pt_sys.palette_top; i++) {
+        pt_dither dither = pt_sys.dither[i];
+        set_dither_from_remapper(remapper, mode, i, &dither);
+        // Only the images which use a slot with a different dither need to be reconverted
+        if ((dither.type != pt_sys.dither[i].type) || (dither.idx_a != pt_sys.dither[i].idx_a)
+            || (dither.idx_b != pt_sys.dither[i].idx_b)) {
+            pt_sys.dither[i] = dither;
+            dither_update_tile(i);
+            palette_touch_slot(i);
+        }
+    }
+}
+
+void palette_touch_slot(uint8_t idx)
+{
+    pt_sys.palette_revision++;
+    pt_sys.slot_revision[idx] = pt_sys.palette_revision;
+}
+
+void palette_deps_init(pt_palette_deps* deps)
+{
+    deps->revision = pt_sys.palette_revision;
+    memset(deps->slots, 0, sizeof(deps->slots));
+}
+
+void palette_deps_merge(pt_palette_deps* dest, pt_palette_deps* src)
+{
+    for (int i = 0; i < 8; i++) {
+        dest->slots[i] |= src->slots[i];
+    }
+}
+
+bool palette_deps_current(pt_palette_deps* deps)
+{
+    if (deps->revision == pt_sys.palette_revision)
+        return true;
+    for (int i = 0; i < 256; i++) {
+        if ((deps->slots[i >> 5] & (1u << (i & 31))) && (pt_sys.slot_revision[i] > deps->revision))
+            return false;
+    }
+    // Nothing used has changed; skip the check until the next change
+    deps->revision = pt_sys.palette_revision;
+    return true;
 }
@@ -1,6 +1,7 @@
 #ifndef PERENTIE_COLOUR_H
 #define PERENTIE_COLOUR_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -9,6 +10,8 @@ typedef uint8_t byte;
 typedef struct pt_colour_rgb pt_colour_rgb;
 typedef struct pt_colour_oklab pt_colour_oklab;
 typedef struct pt_dither pt_dither;
+typedef struct pt_palette_deps pt_palette_deps;
+typedef struct pt_dither_map pt_dither_map;
 
 struct pt_colour_rgb {
     byte r;
@@ -76,15 +79,62 @@ enum pt_ega {
     EGA_WHITE = 15
 };
 
+// Palette slots which a converted image was built from.
+// Each slot records the palette revision when its colour mapping last
+// changed (pt_sys.slot_revision); an image only needs to be reconverted
+// if one of its own slots has changed since it was built.
+struct pt_palette_deps {
+    int revision;
+    uint32_t slots[8];
+};
+
 extern pt_colour_rgb ega_palette[16];
 
 void set_dither_from_remapper(
     enum pt_palette_remapper remapper, enum pt_palette_remapper_mode mode, uint8_t idx, pt_dither* dest);
 void get_ega_dither_for_colour(enum pt_palette_remapper_mode mode, pt_colour_rgb* src, pt_dither* dest);
 uint8_t map_colour(uint8_t r, uint8_t g, uint8_t b);
+void rgb8_to_oklab(pt_colour_rgb* src, pt_colour_oklab* dest);
+int oklab_table_nearest_scalar(const pt_colour_oklab* src, const pt_colour_oklab* table, int count, float* dist);
+int oklab_table_nearest(const pt_colour_oklab* src, const float* planes, int count, float* dist);
 void dither_set_hint(pt_colour_rgb* src, enum pt_dither_type type, pt_colour_rgb* a, pt_colour_rgb* b);
 uint8_t dither_calc(uint8_t src, int16_t x, int16_t y);
 
+// Dither patterns resolved for every entry of an image palette up front.
+// Converting a pixel is then a lookup: phase[dither_phase(x, y)][pixel]
+struct pt_dither_map {
+    uint8_t phase[8][256];
+};
+
+void dither_build_map(const uint8_t* palette_map, pt_dither_map* dest);
+
+static inline int dither_phase(int16_t x, int16_t y)
+{
+    return ((y & 1) << 2) | (x & 3);
+}
+
 void palette_init();
+void palette_set_remapper(enum pt_palette_remapper remapper, enum pt_palette_remapper_mode mode);
+void palette_touch_slot(uint8_t idx);
+
+void palette_deps_init(pt_palette_deps* deps);
+void palette_deps_merge(pt_palette_deps* dest, pt_palette_deps* src);
+bool palette_deps_current(pt_palette_deps* deps);
+
+static inline void palette_deps_add(pt_palette_deps* deps, uint8_t idx)
+{
+    deps->slots[idx >> 5] |= 1u << (idx & 31);
+}
+
+// Palette effects only change the colours shown for palette slots
+// (i.e. pt_sys.palette_display), and never the converted image data.
+#define PALETTE_CYCLE_MAX 16
+#define PALETTE_CYCLE_LENGTH 64
+
+uint32_t palette_cycle_add(uint8_t* slots, int count, uint32_t delay, bool reverse);
+bool palette_cycle_remove(uint32_t id);
+void palette_fade(pt_colour_rgb* colour, float amount, uint32_t duration);
+bool palette_is_fading();
+void palette_update_effects(uint32_t millis);
 
 #endif
@@ -0,0 +1,342 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "dirty.h"
+#include "image.h"
+#include "log.h"
+#include "system.h"
+#include "utils.h"
+
+// Number of frames of dirty rectangles to keep.
+// Page flipping on VGA means the back page is two frames stale.
+#define DIRTY_HISTORY 2
+// How far ahead to look for a matching op when the logs fall out of step,
+// e.g. when an object has been added or removed from the render list.
+#define DIRTY_RESYNC_WINDOW 8
+
+#define DIRTY_OP_TYPE(param) ((param) >> 24)
+#define DIRTY_OP_PARAM(type, value) (((uint32_t)(type) << 24) | ((value) & 0xffffff))
+
+typedef struct pt_dirty_log pt_dirty_log;
+typedef struct pt_dirty_set pt_dirty_set;
+
+struct pt_dirty_log {
+    pt_dirty_op* ops;
+    size_t count;
+    size_t size;
+};
+
+struct pt_dirty_set {
+    struct rect rects[DIRTY_MAX_RECTS];
+    size_t count;
+};
+
+static pt_dirty_log dirty_logs[2] = { 0 };
+static size_t dirty_log_idx = 0;
+static pt_dirty_set dirty_frames[DIRTY_HISTORY] = { 0 };
+static pt_dirty_set dirty_result = { 0 };
+static struct rect dirty_screen = { 0 };
+static bool dirty_all = true;
+static int dirty_revision = 0;
+
+void dirty_init(int16_t width, int16_t height)
+{
+    dirty_screen.left = 0;
+    dirty_screen.top = 0;
+    dirty_screen.right = width;
+    dirty_screen.bottom = height;
+    for (int i = 0; i < 2; i++) {
+        dirty_logs[i].count = 0;
+    }
+    memset(dirty_frames, 0, sizeof(pt_dirty_set) * DIRTY_HISTORY);
+    dirty_revision = pt_sys.palette_revision;
+    dirty_all = true;
+}
+
+static inline int32_t rect_area(struct rect* rect)
+{
+    return (int32_t)rect_width(rect) * (int32_t)rect_height(rect);
+}
+
+static inline bool rect_touches_rect(struct rect* a, struct rect* b)
+{
+    return (a->left <= b->right) && (b->left <= a->right) && (a->top <= b->bottom) && (b->top <= a->bottom);
+}
+
+static inline void rect_union(struct rect* a, struct rect* b, struct rect* dest)
+{
+    dest->left = MIN(a->left, b->left);
+    dest->top = MIN(a->top, b->top);
+    dest->right = MAX(a->right, b->right);
+    dest->bottom = MAX(a->bottom, b->bottom);
+}
+
+static void dirty_set_add(pt_dirty_set* set, struct rect* area)
+{
+    struct rect r = { MAX(area->left, dirty_screen.left), MAX(area->top, dirty_screen.top),
+        MIN(area->right, dirty_screen.right), MIN(area->bottom, dirty_screen.bottom) };
+    if (rect_is_empty(&r))
+        return;
+
+    // Fold in every rectangle that overlaps or abuts the new one,
+    // so that the set stays disjoint.
+    size_t i = 0;
+    while (i < set->count) {
+        if (rect_contains_rect(&set->rects[i], &r))
+            return;
+        if (rect_touches_rect(&set->rects[i], &r)) {
+            rect_union(&set->rects[i], &r, &r);
+            set->count--;
+            set->rects[i] = set->rects[set->count];
+            i = 0;
+            continue;
+        }
+        i++;
+    }
+
+    if (set->count == DIRTY_MAX_RECTS) {
+        // Out of slots; merge with whichever rectangle grows the least.
+        size_t best = 0;
+        int32_t best_growth = INT32_MAX;
+        for (i = 0; i < set->count; i++) {
+            struct rect test;
+            rect_union(&set->rects[i], &r, &test);
+            int32_t growth = rect_area(&test) - rect_area(&set->rects[i]);
+            if (growth < best_growth) {
+                best = i;
+                best_growth = growth;
+            }
+        }
+        rect_union(&set->rects[best], &r, &r);
+        set->count--;
+        set->rects[best] = set->rects[set->count];
+        dirty_set_add(set, &r);
+        return;
+    }
+
+    set->rects[set->count] = r;
+    set->count++;
+}
+
+static void dirty_log_push(const pt_dirty_op* op)
+{
+    pt_dirty_log* log = &dirty_logs[dirty_log_idx];
+    if (log->count == log->size) {
+        size_t size = log->size ? log->size * 2 : 64;
+        pt_dirty_op* ops = (pt_dirty_op*)realloc(log->ops, sizeof(pt_dirty_op) * size);
+        if (!ops) {
+            log_print("dirty_log_push: out of memory\n");
+            dirty_all = true;
+            return;
+        }
+        log->ops = ops;
+        log->size = size;
+    }
+    log->ops[log->count] = *op;
+    log->count++;
+}
+
+void dirty_log_clear(uint8_t colour)
+{
+    pt_dirty_op op = { 0 };
+    op.param = DIRTY_OP_PARAM(DIRTY_OP_CLEAR, colour);
+    op.dest = dirty_screen;
+    dirty_log_push(&op);
+}
+
+void dirty_log_image(pt_image* image, struct rect* src, int16_t x, int16_t y, uint8_t flags)
+{
+    if (!image || !src)
+        return;
+    pt_dirty_op op = { 0 };
+    op.source = image->serial;
+    op.param = DIRTY_OP_PARAM(DIRTY_OP_IMAGE, flags);
+    op.src = *src;
+    op.dest.left = x;
+    op.dest.top = y;
+    op.dest.right = x + rect_width(src);
+    op.dest.bottom = y + rect_height(src);
+    dirty_log_push(&op);
+}
+
+void dirty_log_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint32_t colour)
+{
+    pt_dirty_op op = { 0 };
+    op.param = DIRTY_OP_PARAM(DIRTY_OP_LINE, colour);
+    op.src.left = x0;
+    op.src.top = y0;
+    op.src.right = x1;
+    op.src.bottom = y1;
+    op.dest.left = MIN(x0, x1);
+    op.dest.top = MIN(y0, y1);
+    op.dest.right = MAX(x0, x1) + 1;
+    op.dest.bottom = MAX(y0, y1) + 1;
+    dirty_log_push(&op);
+}
+
+// Ops logged so far this frame
+const pt_dirty_op* dirty_log_get(size_t* count)
+{
+    pt_dirty_log* log = &dirty_logs[dirty_log_idx];
+    if (count)
+        *count = log->count;
+    return log->ops;
+}
+
+// Log a run of ops again; e.g. when a cached copy of what they drew is
+// put back, so the frame still compares equal with one that drew them.
+void dirty_log_replay(const pt_dirty_op* ops, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        dirty_log_push(&ops[i]);
+    }
+}
+
+void dirty_mark(struct rect* area)
+{
+    if (!area)
+        return;
+    dirty_set_add(&dirty_frames[0], area);
+}
+
+void dirty_mark_all()
+{
+    dirty_all = true;
+}
+
+static inline bool dirty_op_equal(pt_dirty_op* a, pt_dirty_op* b)
+{
+    return memcmp(a, b, sizeof(pt_dirty_op)) == 0;
+}
+
+static inline bool dirty_log_starts_clear(pt_dirty_log* log)
+{
+    return (log->count > 0) && (DIRTY_OP_TYPE(log->ops[0].param) == DIRTY_OP_CLEAR);
+}
+
+// Whether this frame started by clearing the screen
+bool dirty_log_cleared()
+{
+    return dirty_log_starts_clear(&dirty_logs[dirty_log_idx]);
+}
+
+static void dirty_diff(pt_dirty_set* set, pt_dirty_log* prev, pt_dirty_log* cur)
+{
+    // Walk both op logs in step. Any op which only exists in one log
+    // (or has changed) dirties the area it touched. Pixels outside of
+    // those areas were produced by the same sequence of ops, so they
+    // are unchanged.
+    size_t p = 0;
+    size_t c = 0;
+    while (p < prev->count && c < cur->count) {
+        if (dirty_op_equal(&prev->ops[p], &cur->ops[c])) {
+            p++;
+            c++;
+            continue;
+        }
+
+        // Ops removed since the last frame
+        size_t k = 1;
+        while ((k <= DIRTY_RESYNC_WINDOW) && (p + k < prev->count)
+            && !dirty_op_equal(&prev->ops[p + k], &cur->ops[c])) {
+            k++;
+        }
+        if ((k <= DIRTY_RESYNC_WINDOW) && (p + k < prev->count)) {
+            for (size_t j = p; j < p + k; j++) {
+                dirty_set_add(set, &prev->ops[j].dest);
+            }
+            p += k;
+            continue;
+        }
+
+        // Ops added since the last frame
+        k = 1;
+        while ((k <= DIRTY_RESYNC_WINDOW) && (c + k < cur->count)
+            && !dirty_op_equal(&prev->ops[p], &cur->ops[c + k])) {
+            k++;
+        }
+        if ((k <= DIRTY_RESYNC_WINDOW) && (c + k < cur->count)) {
+            for (size_t j = c; j < c + k; j++) {
+                dirty_set_add(set, &cur->ops[j].dest);
+            }
+            c += k;
+            continue;
+        }
+
+        // Op changed
+        dirty_set_add(set, &prev->ops[p].dest);
+        dirty_set_add(set, &cur->ops[c].dest);
+        p++;
+        c++;
+    }
+    for (; p < prev->count; p++) {
+        dirty_set_add(set, &prev->ops[p].dest);
+    }
+    for (; c < cur->count; c++) {
+        dirty_set_add(set, &cur->ops[c].dest);
+    }
+}
+
+size_t dirty_end_frame(size_t history, struct rect** rects)
+{
+    pt_dirty_log* cur = &dirty_logs[dirty_log_idx];
+    pt_dirty_log* prev = &dirty_logs[dirty_log_idx ^ 1];
+    pt_dirty_set* frame = &dirty_frames[0];
+
+    // Hardware images get reconverted when the palette changes,
+    // which can change any pixel on the screen.
+    if (dirty_revision != pt_sys.palette_revision) {
+        dirty_revision = pt_sys.palette_revision;
+        dirty_all = true;
+    }
+
+    if (dirty_all) {
+        dirty_set_add(frame, &dirty_screen);
+    } else if (!dirty_log_starts_clear(cur)) {
+        // The framebuffer wasn't cleared, so the only pixels that
+        // changed are the ones drawn this frame.
+        for (size_t i = 0; i < cur->count; i++) {
+            dirty_set_add(frame, &cur->ops[i].dest);
+        }
+    } else if (!dirty_log_starts_clear(prev)) {
+        // Last frame was drawn on top of an older frame; there's
+        // nothing reliable to compare against.
+        dirty_set_add(frame, &dirty_screen);
+    } else {
+        dirty_diff(frame, prev, cur);
+    }
+    dirty_all = false;
+
+    // Combine the requested number of frames
+    history = MAX((size_t)1, MIN(history, (size_t)DIRTY_HISTORY));
+    dirty_result.count = 0;
+    for (size_t i = 0; i < history; i++) {
+        for (size_t j = 0; j < dirty_frames[i].count; j++) {
+            dirty_set_add(&dirty_result, &dirty_frames[i].rects[j]);
+        }
+    }
+
+    // Shuffle along the history, and start a fresh log
+    for (size_t i = DIRTY_HISTORY - 1; i > 0; i--) {
+        dirty_frames[i] = dirty_frames[i - 1];
+    }
+    dirty_frames[0].count = 0;
+    dirty_log_idx ^= 1;
+    dirty_logs[dirty_log_idx].count = 0;
+
+    if (rects)
+        *rects = dirty_result.rects;
+    return dirty_result.count;
+}
+
+void dirty_shutdown()
+{
+    for (int i = 0; i < 2; i++) {
+        if (dirty_logs[i].ops) {
+            free(dirty_logs[i].ops);
+            dirty_logs[i].ops = NULL;
+        }
+        dirty_logs[i].count = 0;
+        dirty_logs[i].size = 0;
+    }
+}
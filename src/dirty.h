@@ -0,0 +1,46 @@
+#ifndef PERENTIE_DIRTY_H
+#define PERENTIE_DIRTY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rect.h"
+
+// Dirty-region tracking for the framebuffer.
+// The video drivers log every drawing operation made during a frame.
+// At the end of the frame the log is compared with the previous frame's,
+// and only the screen areas touched by operations that differ are
+// reported as dirty.
+
+#define DIRTY_MAX_RECTS 16
+
+typedef struct pt_image pt_image;
+typedef struct pt_dirty_op pt_dirty_op;
+
+enum pt_dirty_op_type {
+    DIRTY_OP_CLEAR = 1,
+    DIRTY_OP_IMAGE = 2,
+    DIRTY_OP_LINE = 3,
+};
+
+struct pt_dirty_op {
+    uint32_t source;
+    uint32_t param;
+    struct rect src;
+    struct rect dest;
+};
+
+void dirty_init(int16_t width, int16_t height);
+void dirty_log_clear(uint8_t colour);
+void dirty_log_image(pt_image* image, struct rect* src, int16_t x, int16_t y, uint8_t flags);
+void dirty_log_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint32_t colour);
+const pt_dirty_op* dirty_log_get(size_t* count);
+bool dirty_log_cleared();
+void dirty_log_replay(const pt_dirty_op* ops, size_t count);
+void dirty_mark(struct rect* area);
+void dirty_mark_all();
+size_t dirty_end_frame(size_t history, struct rect** rects);
+void dirty_shutdown();
+
+#endif
@@ -0,0 +1,196 @@
+local description = [=[
+Usage: lua dithertables.lua
+
+Write a C source file to standard output, containing the OKLab colour
+tables used by the EGA/CGA auto-dithering in colour.c:
+
+- ega_oklab: the 16 EGA colours
+- ega_dither_half: every 50/50 blend of two EGA colours
+- ega_dither_quarter: every 25/75 blend of two EGA colours
+
+Each table is also written out as planes (all of the L values, then all
+of the a values, then all of the b values), for searching with SIMD.
+
+Blends which look bad are replaced with EGA black, so they never win a
+nearest colour search. These tables never change, so they are generated
+at build time instead of on startup.
+]=]
+
+if arg and arg[1] then
+    io.stderr:write(description)
+    return
+end
+
+local EGA_BLACK = 0
+local EGA_BLUE = 1
+local EGA_GREEN = 2
+local EGA_CYAN = 3
+local EGA_RED = 4
+local EGA_MAGENTA = 5
+local EGA_BROWN = 6
+local EGA_LGRAY = 7
+local EGA_DGRAY = 8
+local EGA_BRBLUE = 9
+local EGA_BRGREEN = 10
+local EGA_BRCYAN = 11
+local EGA_BRRED = 12
+local EGA_BRMAGENTA = 13
+local EGA_BRYELLOW = 14
+local EGA_WHITE = 15
+
+-- Must match ega_palette in colour.c
+local ega_palette = {
+    { 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0xaa },
+    { 0x00, 0xaa, 0x00 },
+    { 0x00, 0xaa, 0xaa },
+    { 0xaa, 0x00, 0x00 },
+    { 0xaa, 0x00, 0xaa },
+    { 0xaa, 0x55, 0x00 },
+    { 0xaa, 0xaa, 0xaa },
+    { 0x55, 0x55, 0x55 },
+    { 0x55, 0x55, 0xff },
+    { 0x55, 0xff, 0x55 },
+    { 0x55, 0xff, 0xff },
+    { 0xff, 0x55, 0x55 },
+    { 0xff, 0x55, 0xff },
+    { 0xff, 0xff, 0x55 },
+    { 0xff, 0xff, 0xff },
+}
+
+-- Block a bunch of auto-dithering combinations which look bad.
+-- stylua: ignore
+local ega_banned_dithering = {
+    -- Black should only be mixed with dark-range colours
+    EGA_BLACK, EGA_LGRAY,
+    EGA_BLACK, EGA_BRBLUE,
+    EGA_BLACK, EGA_BRGREEN,
+    EGA_BLACK, EGA_BRCYAN,
+    EGA_BLACK, EGA_BRRED,
+    EGA_BLACK, EGA_BRMAGENTA,
+    EGA_BLACK, EGA_BRYELLOW,
+    -- White should only be mixed with light-range colours
+    EGA_BLACK, EGA_WHITE,
+    EGA_BLUE, EGA_WHITE,
+    EGA_GREEN, EGA_WHITE,
+    EGA_CYAN, EGA_WHITE,
+    EGA_RED, EGA_WHITE,
+    EGA_MAGENTA, EGA_WHITE,
+    EGA_BROWN, EGA_WHITE,
+    EGA_DGRAY, EGA_WHITE,
+    -- Dark blue
+    EGA_BLUE, EGA_GREEN,
+    EGA_BLUE, EGA_RED,
+    EGA_BLUE, EGA_BRGREEN,
+    EGA_BLUE, EGA_BRRED,
+    EGA_BLUE, EGA_BRYELLOW,
+    -- Dark green
+    EGA_GREEN, EGA_RED,
+    EGA_GREEN, EGA_MAGENTA,
+    EGA_GREEN, EGA_BRRED,
+    EGA_GREEN, EGA_BRMAGENTA,
+    -- Dark cyan
+    EGA_CYAN, EGA_RED,
+    EGA_CYAN, EGA_MAGENTA,
+    EGA_CYAN, EGA_BROWN,
+    EGA_CYAN, EGA_BRRED,
+    EGA_CYAN, EGA_BRMAGENTA,
+    EGA_CYAN, EGA_BRYELLOW,
+    -- Dark red
+    EGA_RED, EGA_BRBLUE,
+    EGA_RED, EGA_BRGREEN,
+    EGA_RED, EGA_BRCYAN,
+    -- Dark magenta
+    EGA_MAGENTA, EGA_BROWN,
+    EGA_MAGENTA, EGA_BRGREEN,
+    EGA_MAGENTA, EGA_BRCYAN,
+    --EGA_MAGENTA, EGA_BRYELLOW,
+    -- Brown
+    EGA_BROWN, EGA_BRBLUE,
+    EGA_BROWN, EGA_BRGREEN,
+    EGA_BROWN, EGA_BRCYAN,
+    EGA_BROWN, EGA_BRMAGENTA,
+    -- Bright blue
+    --EGA_BRBLUE, EGA_BRGREEN,
+    EGA_BRBLUE, EGA_BRRED,
+    EGA_BRBLUE, EGA_BRYELLOW,
+    -- Bright green
+    EGA_BRGREEN, EGA_BRRED,
+    EGA_BRGREEN, EGA_BRMAGENTA,
+    -- Bright cyan
+    EGA_BRCYAN, EGA_BRRED,
+    EGA_BRCYAN, EGA_BRMAGENTA,
+}
+
+-- Same conversion as rgb8_to_oklab in colour.c
+local function gamma_to_linear(n)
+    return n >= 0.0405 and ((n + 0.055) / 1.055) ^ 2.4 or n / 12.92
+end
+
+local function cbrt(n)
+    return n < 0 and -((-n) ^ (1 / 3)) or n ^ (1 / 3)
+end
+
+local function rgb8_to_oklab(src)
+    local t = gamma_to_linear(src[1] / 255)
+    local i = gamma_to_linear(src[2] / 255)
+    local r = gamma_to_linear(src[3] / 255)
+
+    local u = cbrt(0.4122214708 * t + 0.5363325363 * i + 0.0514459929 * r)
+    local f = cbrt(0.2119034982 * t + 0.6806995451 * i + 0.1073969566 * r)
+    local e = cbrt(0.0883024619 * t + 0.2817188376 * i + 0.6299787005 * r)
+
+    return {
+        u * 0.2104542553 + f * 0.793617785 + e * -0.0040720468,
+        u * 1.9779984951 + f * -2.428592205 + e * 0.4505937099,
+        u * 0.0259040371 + f * 0.7827717662 + e * -0.808675766,
+    }
+end
+
+local function oklab_colour_blend(a, b, alpha)
+    return {
+        a[1] * (1 - alpha) + b[1] * alpha,
+        a[2] * (1 - alpha) + b[2] * alpha,
+        a[3] * (1 - alpha) + b[3] * alpha,
+    }
+end
+
+local ega_oklab = {}
+for i = 0, 15 do
+    ega_oklab[i] = rgb8_to_oklab(ega_palette[i + 1])
+end
+
+local ega_dither_half = {}
+local ega_dither_quarter = {}
+for i = 0, 255 do
+    ega_dither_half[i] = oklab_colour_blend(ega_oklab[i // 16], ega_oklab[i % 16], 0.5)
+    ega_dither_quarter[i] = oklab_colour_blend(ega_oklab[i // 16], ega_oklab[i % 16], 0.75)
+end
+for i = 1, #ega_banned_dithering, 2 do
+    local a = ega_banned_dithering[i]
+    local b = ega_banned_dithering[i + 1]
+    ega_dither_half[b * 16 + a] = ega_oklab[0]
+    ega_dither_half[a * 16 + b] = ega_oklab[0]
+    ega_dither_quarter[b * 16 + a] = ega_oklab[0]
+    ega_dither_quarter[a * 16 + b] = ega_oklab[0]
+end
+
+local function dump(name, tab, count)
+    io.write(("static const pt_colour_oklab %s[%d] = {\n"):format(name, count))
+    for i = 0, count - 1 do
+        io.write(("    { %.9ef, %.9ef, %.9ef },\n"):format(tab[i][1], tab[i][2], tab[i][3]))
+    end
+    io.write("};\n\n")
+    io.write(("static const float %s_planes[%d] = {\n"):format(name, 3 * count))
+    for c = 1, 3 do
+        for i = 0, count - 1 do
+            io.write(("    %.9ef,\n"):format(tab[i][c]))
+        end
+    end
+    io.write("};\n\n")
+end
+
+io.write("/* code automatically generated by dithertables.lua -- DO NOT EDIT */\n\n")
+dump("ega_oklab", ega_oklab, 16)
+dump("ega_dither_half", ega_dither_half, 256)
+dump("ega_dither_quarter", ega_dither_quarter, 256)
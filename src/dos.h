@@ -14,18 +14,6 @@
 #define LOCK_CODE(x) _go32_dpmi_lock_code(x, sizeof(x));
 
 typedef struct pt_image pt_image;
-typedef struct pt_image_vga pt_image_vga;
-
-struct pt_image_vga {
-    byte* bitmap;
-    byte* mask;
-    uint16_t width;
-    uint16_t height;
-    uint16_t pitch;
-    uint16_t plane;
-    uint16_t plane_pitch;
-    int revision;
-};
 
 void dos_yield();
 
@@ -4,6 +4,7 @@
 #include "font.h"
 #include "fs.h"
 #include "log.h"
+#include "text.h"
 #include "utils.h"
 
 void font_load_info_block(PHYSFS_File* fp, size_t size, pt_font* font)
@@ -84,6 +85,62 @@ void font_load_pages_block(PHYSFS_File* fp, size_t size, pt_font* font, const ch
     }
 }
 
+static inline uint32_t font_char_hash_start(pt_font* font, uint32_t codepoint)
+{
+    return (codepoint * 2654435761u) & (font->char_hash_size - 1);
+}
+
+static void font_build_char_index(pt_font* font)
+{
+    memset(font->char_latin1, 0, sizeof(font->char_latin1));
+    size_t high_count = 0;
+    for (size_t i = 0; i < font->char_count; i++) {
+        if (font->chars[i].id >= 256) {
+            high_count++;
+        } else if (!font->char_latin1[font->chars[i].id]) {
+            font->char_latin1[font->chars[i].id] = i + 1;
+        }
+    }
+    if (!high_count)
+        return;
+
+    // Keep the hash at most half full
+    font->char_hash_size = 16;
+    while (font->char_hash_size < high_count * 2)
+        font->char_hash_size *= 2;
+    font->char_hash = (uint32_t*)calloc(font->char_hash_size, sizeof(uint32_t));
+    if (!font->char_hash) {
+        log_print("font_build_char_index: out of memory\n");
+        font->char_hash_size = 0;
+        return;
+    }
+    for (size_t i = 0; i < font->char_count; i++) {
+        uint32_t codepoint = font->chars[i].id;
+        // Keep the first glyph if a codepoint appears more than once
+        if ((codepoint < 256) || (font_find_char(font, codepoint) >= 0))
+            continue;
+        uint32_t j = font_char_hash_start(font, codepoint);
+        while (font->char_hash[j])
+            j = (j + 1) & (font->char_hash_size - 1);
+        font->char_hash[j] = i + 1;
+    }
+}
+
+int font_find_char(pt_font* font, uint32_t codepoint)
+{
+    if (codepoint < 256)
+        return (int)font->char_latin1[codepoint] - 1;
+    if (!font->char_hash)
+        return -1;
+    uint32_t i = font_char_hash_start(font, codepoint);
+    while (font->char_hash[i]) {
+        if (font->chars[font->char_hash[i] - 1].id == codepoint)
+            return font->char_hash[i] - 1;
+        i = (i + 1) & (font->char_hash_size - 1);
+    }
+    return -1;
+}
+
 void font_load_chars_block(PHYSFS_File* fp, size_t size, pt_font* font)
 {
     if (size % 20 != 0) {
@@ -106,6 +163,122 @@ void font_load_chars_block(PHYSFS_File* fp, size_t size, pt_font* font)
         // log_print("font_load_chars_block: id=%d, x=%d, y=%d, width=%d, height=%d\n", font->chars[i].id,
         //      font->chars[i].x, font->chars[i].y, font->chars[i].width, font->chars[i].height);
     }
+    font_build_char_index(font);
+}
+
+static pt_image* font_create_tinted_page(pt_image* page, const byte* colours, const byte* alpha)
+{
+    if (!page || !page->data)
+        return NULL;
+    pt_image* image = create_image(NULL, 0, 0, 0);
+    if (!image)
+        return NULL;
+    image->width = page->width;
+    image->height = page->height;
+    image->pitch = page->pitch;
+    // Borrowed; see font_destroy_tint
+    image->data = page->data;
+    pt_image_palette* palette = create_image_palette(colours, alpha);
+    if (palette) {
+        destroy_image_palette(image->palette);
+        image->palette = palette;
+    }
+    return image;
+}
+
+static void font_destroy_tint(pt_font* font, pt_font_tint* tint)
+{
+    for (size_t i = 0; i < font->page_count; i++) {
+        if (tint->outline && tint->outline[i]) {
+            tint->outline[i]->data = NULL;
+            destroy_image(tint->outline[i]);
+        }
+        if (tint->body && tint->body[i]) {
+            tint->body[i]->data = NULL;
+            destroy_image(tint->body[i]);
+        }
+    }
+    free(tint->outline);
+    free(tint->body);
+    free(tint);
+}
+
+// Whether the page has any pixels that aren't blank or glyph body
+static bool font_page_has_outline(pt_image* page)
+{
+    if (!page || !page->data)
+        return false;
+    for (size_t i = 0; i < (size_t)page->pitch * page->height; i++) {
+        if ((page->data[i] != 0x00) && (page->data[i] != 0xff))
+            return true;
+    }
+    return false;
+}
+
+pt_font_tint* font_get_tint(pt_font* font, const uint8_t* colours)
+{
+    size_t count = 0;
+    for (pt_font_tint** link = &font->tints; *link; link = &(*link)->next) {
+        pt_font_tint* tint = *link;
+        if (!memcmp(tint->colours, colours, sizeof(tint->colours))) {
+            // Move to the front
+            *link = tint->next;
+            tint->next = font->tints;
+            font->tints = tint;
+            return tint;
+        }
+        count++;
+    }
+
+    if (count >= FONT_MAX_TINTS) {
+        // Make room by dropping the least recently used
+        pt_font_tint* last = font->tints;
+        for (size_t i = 1; i < FONT_MAX_TINTS - 1; i++)
+            last = last->next;
+        while (last->next) {
+            pt_font_tint* next = last->next->next;
+            font_destroy_tint(font, last->next);
+            last->next = next;
+        }
+    }
+
+    pt_font_tint* tint = (pt_font_tint*)calloc(1, sizeof(pt_font_tint));
+    if (!tint) {
+        log_print("font_get_tint: out of memory\n");
+        return NULL;
+    }
+    memcpy(tint->colours, colours, sizeof(tint->colours));
+    tint->outline = (pt_image**)calloc(font->page_count ? font->page_count : 1, sizeof(pt_image*));
+    tint->body = (pt_image**)calloc(font->page_count ? font->page_count : 1, sizeof(pt_image*));
+    if (!tint->outline || !tint->body) {
+        log_print("font_get_tint: out of memory\n");
+        font_destroy_tint(font, tint);
+        return NULL;
+    }
+
+    // Same colour scheme as text_to_image; 0x7f is the outline, 0xff is the body.
+    // The outline pages draw every glyph pixel, the body pages go over the top
+    // with only the 0xff pixels; same as merging the glyphs with bitwise OR.
+    byte page_colours[3 * 256] = { 0 };
+    byte page_alpha[256];
+    memset(page_alpha, 0xff, sizeof(page_alpha));
+    memcpy(&page_colours[0x7f * 3], colours + 3, 3);
+    memcpy(&page_colours[0xff * 3], colours + 3, 3);
+    for (size_t i = 0; i < font->page_count; i++) {
+        // Pages with no outline pixels are left out, so text_draw can skip them
+        if (font_page_has_outline(font->pages[i]))
+            tint->outline[i] = font_create_tinted_page(font->pages[i], page_colours, page_alpha);
+    }
+    memcpy(&page_colours[0xff * 3], colours, 3);
+    memset(page_alpha, 0x00, sizeof(page_alpha));
+    page_alpha[0xff] = 0xff;
+    for (size_t i = 0; i < font->page_count; i++) {
+        tint->body[i] = font_create_tinted_page(font->pages[i], page_colours, page_alpha);
+    }
+
+    tint->next = font->tints;
+    font->tints = tint;
+    return tint;
 }
 
 void font_load_kerning_block(PHYSFS_File* fp, size_t size, pt_font* font)
@@ -173,6 +346,13 @@ void destroy_font(pt_font* font)
 {
     if (!font)
         return;
+    // Cached text images point at the font
+    text_cache_purge_font(font);
+    while (font->tints) {
+        pt_font_tint* next = font->tints->next;
+        font_destroy_tint(font, font->tints);
+        font->tints = next;
+    }
     if (font->font_name) {
         free(font->font_name);
         font->font_name = NULL;
@@ -189,5 +369,9 @@ void destroy_font(pt_font* font)
         free(font->chars);
         font->chars = NULL;
     }
+    if (font->char_hash) {
+        free(font->char_hash);
+        font->char_hash = NULL;
+    }
     free(font);
 }
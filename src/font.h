@@ -12,6 +12,7 @@ typedef struct pt_font_page pt_font_page;
 typedef struct pt_font_common pt_font_common;
 typedef struct pt_font_char pt_font_char;
 typedef struct pt_font pt_font;
+typedef struct pt_font_tint pt_font_tint;
 
 typedef uint8_t byte;
 
@@ -41,6 +42,22 @@ struct pt_font_char {
     uint8_t chnl;
 };
 
+// Number of colour combinations to keep tinted pages for
+#define FONT_MAX_TINTS 8
+
+// Copies of the font pages with the outline and body pixels mapped to colours,
+// so glyphs can be drawn straight to the screen. They share the page data.
+struct pt_font_tint {
+    // Body r, g, b, then outline r, g, b
+    uint8_t colours[6];
+    // One image per page. The outline pass draws every glyph pixel in the
+    // outline colour, then the body pass draws over the body. Pages with no
+    // outline pixels have no outline image.
+    pt_image** outline;
+    pt_image** body;
+    pt_font_tint* next;
+};
+
 struct pt_font {
     int32_t font_size;
     uint8_t bit_field;
@@ -63,9 +80,20 @@ struct pt_font {
 
     pt_font_char* chars;
     size_t char_count;
+
+    // Index + 1 into chars for each Latin-1 codepoint, or 0 if missing
+    uint32_t char_latin1[256];
+    // Open-addressed hash of index + 1 into chars for the codepoints above Latin-1
+    uint32_t* char_hash;
+    size_t char_hash_size;
+
+    // Most recently used first
+    pt_font_tint* tints;
 };
 
 pt_font* create_font(char* path);
+int font_find_char(pt_font* font, uint32_t codepoint);
+pt_font_tint* font_get_tint(pt_font* font, const uint8_t* colours);
 void destroy_font(pt_font* font);
 
 #endif
@@ -0,0 +1,376 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "colour.h"
+#include "dirty.h"
+#include "fs.h"
+#include "headless.h"
+#include "image.h"
+#include "linear.h"
+#include "log.h"
+#include "modex.h"
+#include "planar.h"
+#ifndef SYSTEM_DOS
+#include "vgaemu.h"
+#endif
+
+uint64_t headless_wall_micros()
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+    return (uint64_t)clock() * 1000000 / CLOCKS_PER_SEC;
+#endif
+}
+
+// App
+
+void headless_init()
+{
+}
+
+char* headless_get_data_path()
+{
+    char* buffer = (char*)calloc(512, sizeof(char));
+    if (!getcwd(buffer, 511))
+        buffer[0] = '.';
+    size_t idx = strlen(buffer);
+    if (idx < 511 && buffer[idx - 1] != '/')
+        buffer[idx] = '/';
+    return buffer;
+}
+
+void headless_set_meta(const char* name, const char* version, const char* identifier)
+{
+    char* path = headless_get_data_path();
+    fs_set_write_dir(path);
+    free(path);
+}
+
+void headless_shutdown()
+{
+}
+
+pt_drv_app headless_app = { &headless_init, &headless_set_meta, &headless_get_data_path, &headless_shutdown };
+
+// Video
+
+void headless_video_init()
+{
+    linear_init(HEADLESS_WIDTH, HEADLESS_HEIGHT);
+}
+
+void headless_video_shutdown()
+{
+    linear_shutdown();
+}
+
+void headless_video_clear()
+{
+    linear_clear(pt_sys.overscan);
+}
+
+void headless_video_blit_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, pt_colour_rgb* colour)
+{
+    linear_blit_line(x0, y0, x1, y1, map_colour(colour->r, colour->g, colour->b));
+}
+
+void headless_video_blit()
+{
+    // Nothing to copy to, but keep the dirty tracking in step with a real driver
+    dirty_end_frame(1, NULL);
+}
+
+void headless_timer_advance(uint32_t micros);
+
+void headless_video_flip()
+{
+    headless_timer_advance(HEADLESS_FRAME_MICROS);
+}
+
+void headless_video_update_palette_slot(uint8_t idx)
+{
+}
+
+void headless_video_set_palette_remapper(enum pt_palette_remapper remapper, enum pt_palette_remapper_mode mode)
+{
+    palette_set_remapper(remapper, mode);
+}
+
+void headless_video_set_overscan_colour(pt_colour_rgb* colour)
+{
+}
+
+void headless_video_get_screen_dims(uint16_t* w, uint16_t* h)
+{
+    *w = HEADLESS_WIDTH;
+    *h = HEADLESS_HEIGHT;
+}
+
+pt_drv_video headless_video = { &headless_video_init, &headless_video_shutdown, &headless_video_clear,
+    &linear_blit_image, &headless_video_blit_line, &headless_video_blit, &headless_video_flip,
+    &headless_video_update_palette_slot, &linear_destroy_hw_image, &headless_video_set_palette_remapper,
+    &headless_video_set_overscan_colour, &headless_video_get_screen_dims, &linear_save_layer, &linear_restore_layer };
+
+#ifndef SYSTEM_DOS
+// Mode X video; runs the DOS VGA pipeline against an emulated card.
+// DOS builds have the real card, so they leave the emulator out.
+
+void headless_modex_init()
+{
+    modex_init(&vgaemu_hal);
+}
+
+void headless_modex_flip()
+{
+    modex_flip();
+    headless_timer_advance(HEADLESS_FRAME_MICROS);
+}
+
+pt_drv_video headless_video_modex = { &headless_modex_init, &modex_shutdown, &modex_clear, &modex_blit_image,
+    &modex_blit_line, &modex_blit, &headless_modex_flip, &modex_update_palette_slot, &planar_destroy_hw_image,
+    &modex_set_palette_remapper, &modex_set_overscan_colour, &modex_get_screen_dims, &modex_save_layer,
+    &modex_restore_layer };
+#endif
+
+// Timer
+
+static uint64_t timer_micros = 0;
+static uint32_t timer_millis = 0;
+static struct pt_timer_slot timer_slots[256] = { 0 };
+static int timer_slot_head = 0;
+static uint32_t timer_max_callback_id = 0;
+
+void headless_timer_init()
+{
+}
+
+void headless_timer_shutdown()
+{
+    timer_slot_head = 0;
+}
+
+uint32_t headless_timer_ticks()
+{
+    return timer_millis;
+}
+
+uint32_t headless_timer_millis()
+{
+    return timer_millis;
+}
+
+static void headless_timer_remove_slot(int i)
+{
+    timer_slot_head--;
+    if (i != timer_slot_head)
+        timer_slots[i] = timer_slots[timer_slot_head];
+    memset(&timer_slots[timer_slot_head], 0, sizeof(struct pt_timer_slot));
+}
+
+void headless_timer_advance(uint32_t micros)
+{
+    timer_micros += micros;
+    uint32_t target = (uint32_t)(timer_micros / 1000);
+    // Run the timer callbacks for every millisecond that has passed
+    while (timer_millis < target) {
+        timer_millis++;
+        int i = 0;
+        while (i < timer_slot_head) {
+            timer_slots[i].count++;
+            if (timer_slots[i].count >= timer_slots[i].interval) {
+                uint32_t result
+                    = timer_slots[i].callback(timer_slots[i].param, timer_slots[i].id, timer_slots[i].interval);
+                if (result == 0) {
+                    headless_timer_remove_slot(i);
+                    continue;
+                }
+                timer_slots[i].interval = result;
+                timer_slots[i].count = 0;
+            }
+            i++;
+        }
+    }
+}
+
+void headless_timer_sleep(uint32_t millis)
+{
+    headless_timer_advance(millis * 1000);
+}
+
+uint32_t headless_timer_add_callback(uint32_t interval, pt_timer_callback callback, void* param)
+{
+    if (timer_slot_head >= 256)
+        return 0;
+    timer_max_callback_id++;
+    timer_slots[timer_slot_head].id = timer_max_callback_id;
+    timer_slots[timer_slot_head].count = 0;
+    timer_slots[timer_slot_head].interval = interval;
+    timer_slots[timer_slot_head].callback = callback;
+    timer_slots[timer_slot_head].param = param;
+    timer_slot_head++;
+    return timer_max_callback_id;
+}
+
+bool headless_timer_remove_callback(uint32_t id)
+{
+    for (int i = 0; i < timer_slot_head; i++) {
+        if (timer_slots[i].id == id) {
+            headless_timer_remove_slot(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool headless_timer_supports_hires()
+{
+    return false;
+}
+
+bool headless_timer_get_hires()
+{
+    return false;
+}
+
+void headless_timer_set_hires(bool enabled)
+{
+}
+
+pt_drv_timer headless_timer = { &headless_timer_init, &headless_timer_shutdown, &headless_timer_ticks,
+    &headless_timer_millis, &headless_timer_sleep, &headless_timer_add_callback, &headless_timer_remove_callback,
+    &headless_timer_supports_hires, &headless_timer_get_hires, &headless_timer_set_hires };
+
+// Input, plus no-op handlers shared by the other drivers
+
+void headless_driver_init()
+{
+}
+
+void headless_driver_update()
+{
+}
+
+void headless_driver_shutdown()
+{
+}
+
+void headless_keyboard_set_key_repeat(bool allow)
+{
+}
+
+bool headless_keyboard_is_key_down(const char* key)
+{
+    return false;
+}
+
+pt_drv_keyboard headless_keyboard = { &headless_driver_init, &headless_driver_update, &headless_driver_shutdown,
+    &headless_keyboard_set_key_repeat, &headless_keyboard_is_key_down };
+
+int headless_mouse_get_x()
+{
+    return 0;
+}
+
+int headless_mouse_get_y()
+{
+    return 0;
+}
+
+bool headless_mouse_is_button_down(enum pt_mouse_button button)
+{
+    return false;
+}
+
+bool headless_mouse_using_touch()
+{
+    return false;
+}
+
+pt_drv_mouse headless_mouse = { &headless_driver_init, &headless_driver_update, &headless_driver_shutdown,
+    &headless_mouse_get_x, &headless_mouse_get_y, &headless_mouse_is_button_down, &headless_mouse_using_touch };
+
+// Serial
+
+void headless_serial_open_device(const char* device)
+{
+}
+
+void headless_serial_close_device()
+{
+}
+
+bool headless_serial_rx_ready()
+{
+    return false;
+}
+
+bool headless_serial_tx_ready()
+{
+    return true;
+}
+
+byte headless_serial_getc()
+{
+    return 0;
+}
+
+int headless_serial_gets(byte* buffer, size_t length)
+{
+    return 0;
+}
+
+void headless_serial_putc(byte data)
+{
+}
+
+size_t headless_serial_write(const void* buffer, size_t size)
+{
+    return size;
+}
+
+int headless_serial_printf(const char* format, ...)
+{
+    return 0;
+}
+
+pt_drv_serial headless_serial = { &headless_driver_init, &headless_driver_shutdown, &headless_serial_open_device,
+    &headless_serial_close_device, &headless_serial_rx_ready, &headless_serial_tx_ready, &headless_serial_getc,
+    &headless_serial_gets, &headless_serial_putc, &headless_serial_write, &headless_serial_printf };
+
+// Audio; register writes are discarded, but callbacks still run off the virtual clock
+
+void headless_opl_write_reg(uint16_t addr, uint8_t data)
+{
+}
+
+bool headless_opl_is_ready()
+{
+    return true;
+}
+
+pt_drv_opl headless_opl = { &headless_driver_init, &headless_driver_shutdown, &headless_opl_write_reg,
+    &headless_opl_is_ready, &headless_timer_add_callback, &headless_timer_remove_callback };
+
+void headless_beep_set_gate(bool enabled)
+{
+}
+
+void headless_beep_set_mode(uint16_t mode, bool word)
+{
+}
+
+void headless_beep_set_counter_8(uint8_t counter)
+{
+}
+
+void headless_beep_set_counter_16(uint16_t counter)
+{
+}
+
+pt_drv_beep headless_beep = { &headless_driver_init, &headless_driver_shutdown, &headless_beep_set_gate,
+    &headless_beep_set_mode, &headless_beep_set_counter_8, &headless_beep_set_counter_16 };
@@ -0,0 +1,40 @@
+#ifndef PERENTIE_HEADLESS_H
+#define PERENTIE_HEADLESS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "system.h"
+
+// Driver set for running without a display, audio or input devices.
+// Video is composited into an in-memory framebuffer, audio is discarded,
+// and the timer runs on a virtual clock that advances one frame per flip.
+
+#define HEADLESS_WIDTH 320
+#define HEADLESS_HEIGHT 200
+// Length of a virtual frame, in microseconds (60Hz)
+#define HEADLESS_FRAME_MICROS 16667
+
+uint64_t headless_wall_micros();
+
+extern pt_drv_video headless_video;
+
+#ifndef SYSTEM_DOS
+extern pt_drv_video headless_video_modex;
+#endif
+
+extern pt_drv_timer headless_timer;
+
+extern pt_drv_beep headless_beep;
+
+extern pt_drv_mouse headless_mouse;
+
+extern pt_drv_keyboard headless_keyboard;
+
+extern pt_drv_serial headless_serial;
+
+extern pt_drv_opl headless_opl;
+
+extern pt_drv_app headless_app;
+
+#endif
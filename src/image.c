@@ -12,18 +12,161 @@
 #include "system.h"
 #include "utils.h"
 
+static uint32_t image_serial = 0;
+
+#define IMAGE_PALETTE_BUCKETS 64
+static pt_image_palette* image_palettes[IMAGE_PALETTE_BUCKETS] = { 0 };
+
+static uint32_t image_palette_hash(const byte* colours, const byte* alpha)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 3 * 256; i++) {
+        hash = (hash ^ colours[i]) * 16777619u;
+    }
+    for (int i = 0; i < 256; i++) {
+        hash = (hash ^ alpha[i]) * 16777619u;
+    }
+    return hash;
+}
+
+pt_image_palette* create_image_palette(const byte* colours, const byte* alpha)
+{
+    // Missing colours are black, missing alpha is opaque
+    byte default_colours[3 * 256];
+    byte default_alpha[256];
+    if (!colours) {
+        memset(default_colours, 0x00, sizeof(default_colours));
+        colours = default_colours;
+    }
+    if (!alpha) {
+        memset(default_alpha, 0xff, sizeof(default_alpha));
+        alpha = default_alpha;
+    }
+
+    uint32_t hash = image_palette_hash(colours, alpha);
+    pt_image_palette** bucket = &image_palettes[hash % IMAGE_PALETTE_BUCKETS];
+    for (pt_image_palette* palette = *bucket; palette; palette = palette->next) {
+        if ((palette->hash == hash) && !memcmp(palette->colours, colours, sizeof(palette->colours))
+            && !memcmp(palette->alpha, alpha, sizeof(palette->alpha))) {
+            palette->refs++;
+            return palette;
+        }
+    }
+
+    pt_image_palette* palette = (pt_image_palette*)calloc(1, sizeof(pt_image_palette));
+    if (!palette) {
+        log_print("create_image_palette: out of memory\n");
+        return NULL;
+    }
+    memcpy(palette->colours, colours, sizeof(palette->colours));
+    memcpy(palette->alpha, alpha, sizeof(palette->alpha));
+    palette->hash = hash;
+    palette->refs = 1;
+    palette->next = *bucket;
+    *bucket = palette;
+    return palette;
+}
+
+const byte* image_palette_get_map(pt_image_palette* palette)
+{
+    if (!palette->map_valid || (palette->map_epoch != pt_sys.palette_epoch)) {
+        for (int i = 0; i < 256; i++) {
+            palette->map[i]
+                = map_colour(palette->colours[3 * i], palette->colours[3 * i + 1], palette->colours[3 * i + 2]);
+        }
+        palette->map_epoch = pt_sys.palette_epoch;
+        palette->map_valid = true;
+        palette->dither_valid = false;
+    }
+    return palette->map;
+}
+
+pt_dither_map* image_palette_get_dither_map(pt_image_palette* palette)
+{
+    const byte* map = image_palette_get_map(palette);
+    if (!palette->dither_valid || !palette_deps_current(&palette->dither_deps)) {
+        palette_deps_init(&palette->dither_deps);
+        for (int i = 0; i < 256; i++) {
+            palette_deps_add(&palette->dither_deps, map[i]);
+        }
+        dither_build_map(map, &palette->dither_map);
+        palette->dither_valid = true;
+    }
+    return &palette->dither_map;
+}
+
+void destroy_image_palette(pt_image_palette* palette)
+{
+    if (!palette)
+        return;
+    palette->refs--;
+    if (palette->refs > 0)
+        return;
+    pt_image_palette** link = &image_palettes[palette->hash % IMAGE_PALETTE_BUCKETS];
+    while (*link && (*link != palette))
+        link = &(*link)->next;
+    if (*link)
+        *link = palette->next;
+    free(palette);
+}
+
 pt_image* create_image(char* path, int16_t origin_x, int16_t origin_y, int16_t colourkey)
 {
     pt_image* image = (pt_image*)calloc(1, sizeof(pt_image));
     image->path = path;
     image->origin_x = origin_x;
     image->origin_y = origin_y;
-    memset(image->palette_alpha, 0xff, 256);
+    image->palette = create_image_palette(NULL, NULL);
     image->colourkey = colourkey;
+    image->refs = 1;
+    // Unique ID for the image, so the renderer can tell
+    // two images apart even if one reuses the other's memory.
+    image->serial = ++image_serial;
     image_load(image);
     return image;
 }
 
+pt_image* create_image_copy(pt_image* image)
+{
+    if (!image)
+        return NULL;
+    pt_image* copy = (pt_image*)calloc(1, sizeof(pt_image));
+    if (!copy) {
+        log_print("create_image_copy: out of memory\n");
+        return NULL;
+    }
+    if (image->data) {
+        size_t size = (size_t)image->pitch * image->height;
+        copy->data = (byte*)malloc(size);
+        if (!copy->data) {
+            log_print("create_image_copy: out of memory\n");
+            free(copy);
+            return NULL;
+        }
+        memcpy(copy->data, image->data, size);
+    }
+    if (image->path) {
+        size_t path_len = strlen(image->path) + 1;
+        copy->path = (char*)malloc(path_len);
+        if (copy->path)
+            memcpy(copy->path, image->path, path_len);
+    }
+    // Palettes are interned, so the copy can share the original's
+    copy->palette = image->palette;
+    if (copy->palette)
+        copy->palette->refs++;
+    copy->width = image->width;
+    copy->height = image->height;
+    copy->origin_x = image->origin_x;
+    copy->origin_y = image->origin_y;
+    copy->pitch = image->pitch;
+    copy->colourkey = image->colourkey;
+    copy->refs = 1;
+    copy->serial = ++image_serial;
+    return copy;
+}
+
 int image_read_fn(spng_ctx* ctx, void* user, void* data, size_t n)
 {
     PHYSFS_File* file = user;
@@ -94,13 +237,17 @@ bool image_load(pt_image* image)
     image->pitch = get_pitch(ihdr.width);
     image->data = (byte*)calloc(image->height * image->pitch, sizeof(byte));
 
+    byte colours[3 * 256] = { 0 };
+    byte alpha[256];
+    memset(alpha, 0xff, sizeof(alpha));
+
     if (ihdr.color_type == SPNG_COLOR_TYPE_INDEXED) {
         struct spng_plte pal;
         spng_get_plte(ctx, &pal);
         for (size_t i = 0; i < pal.n_entries; i++) {
-            image->palette[3 * i] = pal.entries[i].red;
-            image->palette[3 * i + 1] = pal.entries[i].green;
-            image->palette[3 * i + 2] = pal.entries[i].blue;
+            colours[3 * i] = pal.entries[i].red;
+            colours[3 * i + 1] = pal.entries[i].green;
+            colours[3 * i + 2] = pal.entries[i].blue;
         }
         struct spng_trns trns;
         int result = spng_get_trns(ctx, &trns);
@@ -108,46 +255,46 @@ bool image_load(pt_image* image)
             // log_print("trns: %d\n", result);
             for (size_t i = 0; i < (trns.n_type3_entries > 256 ? 256 : trns.n_type3_entries); i++) {
                 // log_print("%d: %02x\n", i, trns.type3_alpha[i]);
-                image->palette_alpha[i] = trns.type3_alpha[i];
+                alpha[i] = trns.type3_alpha[i];
             }
         }
     } else if (ihdr.color_type == SPNG_COLOR_TYPE_GRAYSCALE) {
         switch (ihdr.bit_depth) {
         case 8:
             for (size_t i = 0; i < 256; i++) {
-                image->palette[3 * i] = i;
-                image->palette[3 * i + 1] = i;
-                image->palette[3 * i + 2] = i;
+                colours[3 * i] = i;
+                colours[3 * i + 1] = i;
+                colours[3 * i + 2] = i;
             }
             break;
         case 4:
             for (size_t i = 0; i < 16; i++) {
-                image->palette[3 * i] = i + (i << 4);
-                image->palette[3 * i + 1] = i + (i << 4);
-                image->palette[3 * i + 2] = i + (i << 4);
+                colours[3 * i] = i + (i << 4);
+                colours[3 * i + 1] = i + (i << 4);
+                colours[3 * i + 2] = i + (i << 4);
             }
             break;
         case 2:
-            image->palette[0] = 0x00;
-            image->palette[1] = 0x00;
-            image->palette[2] = 0x00;
-            image->palette[3] = 0x55;
-            image->palette[4] = 0x55;
-            image->palette[5] = 0x55;
-            image->palette[6] = 0xaa;
-            image->palette[7] = 0xaa;
-            image->palette[8] = 0xaa;
-            image->palette[9] = 0xff;
-            image->palette[10] = 0xff;
-            image->palette[11] = 0xff;
+            colours[0] = 0x00;
+            colours[1] = 0x00;
+            colours[2] = 0x00;
+            colours[3] = 0x55;
+            colours[4] = 0x55;
+            colours[5] = 0x55;
+            colours[6] = 0xaa;
+            colours[7] = 0xaa;
+            colours[8] = 0xaa;
+            colours[9] = 0xff;
+            colours[10] = 0xff;
+            colours[11] = 0xff;
             break;
         case 1:
-            image->palette[0] = 0x00;
-            image->palette[1] = 0x00;
-            image->palette[2] = 0x00;
-            image->palette[3] = 0xff;
-            image->palette[4] = 0xff;
-            image->palette[5] = 0xff;
+            colours[0] = 0x00;
+            colours[1] = 0x00;
+            colours[2] = 0x00;
+            colours[3] = 0xff;
+            colours[4] = 0xff;
+            colours[5] = 0xff;
             break;
         default:
             break;
@@ -157,7 +304,7 @@ bool image_load(pt_image* image)
         int result = spng_get_trns(ctx, &trns);
         if (result == 0) {
             if (trns.gray < 256) {
-                image->palette_alpha[trns.gray] = 0x00;
+                alpha[trns.gray] = 0x00;
             }
         }
     }
@@ -219,6 +366,11 @@ bool image_load(pt_image* image)
     spng_ctx_free(ctx);
     fs_fclose(fp);
 
+    pt_image_palette* palette = create_image_palette(colours, alpha);
+    if (palette) {
+        destroy_image_palette(image->palette);
+        image->palette = palette;
+    }
     return true;
 }
 
@@ -234,7 +386,7 @@ bool image_test_collision(pt_image* image, int16_t x, int16_t y, bool mask, uint
         byte* ptr = image->data;
         ptr += image->pitch * ((flags & FLIP_V) ? (image_bottom(image) - 1 - y) : (y - image_top(image)));
         ptr += (flags & FLIP_H) ? (image_right(image) - 1 - x) : (x - image_left(image));
-        if ((*ptr == image->colourkey) || (image->palette_alpha[*ptr] == 0x00))
+        if ((*ptr == image->colourkey) || (image->palette->alpha[*ptr] == 0x00))
             return false;
     }
     return true;
@@ -326,11 +478,25 @@ void image_blit_9slice(pt_image* image, int16_t x, int16_t y, uint8_t flags, uin
     pt_sys.video->blit_image(image, x + x2_blit, y + y2_blit, flags, x2, y2, image->width, image->height);
 }
 
+void image_touch(pt_image* image)
+{
+    if (!image)
+        return;
+    if (image->hw_image) {
+        pt_sys.video->destroy_hw_image(image->hw_image);
+        image->hw_image = NULL;
+    }
+    image->serial = ++image_serial;
+}
+
 void destroy_image(pt_image* image)
 {
     if (!image) {
         return;
     }
+    image->refs--;
+    if (image->refs > 0)
+        return;
     if (image->data) {
         free(image->data);
         image->data = NULL;
@@ -343,5 +509,7 @@ void destroy_image(pt_image* image)
         free(image->path);
         image->path = NULL;
     }
+    destroy_image_palette(image->palette);
+    image->palette = NULL;
     free(image);
 }
@@ -4,20 +4,45 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "colour.h"
+
 typedef unsigned char byte;
 typedef struct pt_image pt_image;
+typedef struct pt_image_palette pt_image_palette;
+
+// Image palettes are interned by their contents, and shared between all
+// of the images that use them. Conversion work which only depends on the
+// palette is cached here, so it happens once per palette instead of once
+// per image.
+struct pt_image_palette {
+    byte colours[3 * 256];
+    byte alpha[256];
+    uint32_t hash;
+    int refs;
+    pt_image_palette* next;
+    // Global palette slot for each colour; good until the next palette_init
+    byte map[256];
+    int map_epoch;
+    bool map_valid;
+    // Slots that the dither map was built from
+    pt_palette_deps dither_deps;
+    bool dither_valid;
+    pt_dither_map dither_map;
+};
 
 struct pt_image {
     char* path;
     byte* data;
-    byte palette[3 * 256];
-    byte palette_alpha[256];
+    pt_image_palette* palette;
     uint16_t width;
     uint16_t height;
     int16_t origin_x;
     int16_t origin_y;
     uint16_t pitch;
     int16_t colourkey;
+    uint32_t serial;
+    // Number of owners; destroy_image drops one
+    int refs;
 
     void* hw_image;
 };
@@ -55,12 +80,21 @@ static inline int16_t image_bottom(pt_image* image)
     return image->height - image->origin_y;
 }
 
+pt_image_palette* create_image_palette(const byte* colours, const byte* alpha);
+const byte* image_palette_get_map(pt_image_palette* palette);
+pt_dither_map* image_palette_get_dither_map(pt_image_palette* palette);
+void destroy_image_palette(pt_image_palette* palette);
+
 pt_image* create_image(char* path, int16_t origin_x, int16_t origin_y, int16_t colourkey);
+pt_image* create_image_copy(pt_image* image);
 bool image_load(pt_image* image);
 bool image_test_collision(pt_image* image, int16_t x, int16_t y, bool mask, uint8_t flags);
 bool image_test_collision_9slice(pt_image* image, int16_t x, int16_t y, bool mask, uint8_t flags, uint16_t width,
     uint16_t height, int16_t x1, int16_t y1, int16_t x2, int16_t y2);
 void image_blit(pt_image* image, int16_t x, int16_t y, uint8_t flags);
+// Call after changing the pixels of an image in place; drops the converted
+// copy and gives it a new serial, so the renderer doesn't reuse the old one.
+void image_touch(pt_image* image);
 void destroy_image(pt_image* image);
 void image_blit_9slice(pt_image* image, int16_t x, int16_t y, uint8_t flags, uint16_t width, uint16_t height,
     int16_t x1, int16_t y1, int16_t x2, int16_t y2);
@@ -0,0 +1,326 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "colour.h"
+#include "dirty.h"
+#include "image.h"
+#include "linear.h"
+#include "log.h"
+#include "rect.h"
+#include "utils.h"
+
+static byte* linear_framebuffer = NULL;
+static byte* linear_layer = NULL;
+static int16_t linear_width = 0;
+static int16_t linear_height = 0;
+
+bool linear_init(int16_t width, int16_t height)
+{
+    if (linear_framebuffer)
+        return true;
+    linear_framebuffer = (byte*)calloc(width * height, sizeof(byte));
+    if (!linear_framebuffer) {
+        log_print("linear_init: failed to allocate %dx%d framebuffer\n", width, height);
+        return false;
+    }
+    linear_width = width;
+    linear_height = height;
+    dirty_init(width, height);
+    return true;
+}
+
+byte* linear_get_framebuffer()
+{
+    return linear_framebuffer;
+}
+
+void linear_clear(uint8_t colour)
+{
+    if (!linear_framebuffer)
+        return;
+    memset(linear_framebuffer, colour, linear_width * linear_height);
+    dirty_log_clear(colour);
+}
+
+static void linear_cache_flipped(pt_image_linear* image)
+{
+    image->bitmap_flipped = (byte*)calloc(image->pitch * image->height, sizeof(byte));
+    image->mask_flipped = (byte*)calloc(image->pitch * image->height, sizeof(byte));
+    if (!image->bitmap_flipped || !image->mask_flipped) {
+        free(image->bitmap_flipped);
+        free(image->mask_flipped);
+        image->bitmap_flipped = NULL;
+        image->mask_flipped = NULL;
+        return;
+    }
+    for (int y = 0; y < image->height; y++) {
+        byte* src_bitmap = image->bitmap + y * image->pitch;
+        byte* src_mask = image->mask + y * image->pitch;
+        byte* dest_bitmap = image->bitmap_flipped + y * image->pitch + image->width - 1;
+        byte* dest_mask = image->mask_flipped + y * image->pitch + image->width - 1;
+        for (int x = 0; x < image->width; x++) {
+            *dest_bitmap-- = *src_bitmap++;
+            *dest_mask-- = *src_mask++;
+        }
+    }
+}
+
+void linear_blit_image(
+    pt_image* image, int16_t x, int16_t y, uint8_t flags, int16_t left, int16_t top, int16_t right, int16_t bottom)
+{
+    if (!linear_framebuffer) {
+        log_print("linear_blit_image: driver not inited!\n");
+        return;
+    }
+    if (!image) {
+        log_print("linear_blit_image: image is NULL!\n");
+        return;
+    }
+
+    if (image->hw_image && !palette_deps_current(&((pt_image_linear*)image->hw_image)->deps)) {
+        linear_destroy_hw_image(image->hw_image);
+        image->hw_image = NULL;
+    }
+
+    if (!image->hw_image) {
+        image->hw_image = (void*)linear_convert_image(image);
+        if (!image->hw_image) {
+            log_error("linear_blit_image: failed to create hardware image for %s\n", image->path);
+            return;
+        }
+    }
+
+    pt_image_linear* hw_image = (pt_image_linear*)image->hw_image;
+
+    struct rect ir = { MIN(image->width, MAX(0, left)), MIN(image->height, MAX(0, top)),
+        MIN(image->width, MAX(0, right)), MIN(image->height, MAX(0, bottom)) };
+
+    struct rect crop = { 0, 0, linear_width, linear_height };
+
+    // Constrain x and y to be an absolute start offset in screen space.
+    // Crop the image rectangle, based on its location in screen space.
+    if (!rect_blit_clip(&x, &y, &ir, &crop)) {
+        return;
+    }
+    dirty_log_image(image, &ir, x, y, flags);
+
+    byte* src_bitmap = hw_image->bitmap;
+    byte* src_mask = hw_image->mask;
+    bool reverse = flags & FLIP_H;
+    if (reverse) {
+        // sprites facing the other way get drawn flipped every frame,
+        // so past a point it's worth keeping a mirrored copy
+        if (!hw_image->bitmap_flipped && (hw_image->flip_count < LINEAR_FLIP_CACHE_THRESHOLD)) {
+            hw_image->flip_count++;
+            if (hw_image->flip_count == LINEAR_FLIP_CACHE_THRESHOLD)
+                linear_cache_flipped(hw_image);
+        }
+        if (hw_image->bitmap_flipped) {
+            // column ir.left of the mirrored copy lands on screen column x
+            src_bitmap = hw_image->bitmap_flipped;
+            src_mask = hw_image->mask_flipped;
+            reverse = false;
+        }
+    }
+
+    // after the image rect has been clipped, flip it if required
+    if (reverse) {
+        int16_t tmp = ir.right;
+        ir.right = hw_image->width - ir.left;
+        ir.left = hw_image->width - tmp;
+    }
+
+    if (flags & FLIP_V) {
+        int16_t tmp = ir.bottom;
+        ir.bottom = hw_image->height - ir.top;
+        ir.top = hw_image->height - tmp;
+    }
+
+    int16_t width = rect_width(&ir);
+    for (int yi = ir.top; yi < ir.bottom; yi++) {
+        uint8_t* hw_bitmap = src_bitmap + yi * hw_image->pitch + ir.left;
+        uint8_t* hw_mask = src_mask + yi * hw_image->pitch + ir.left;
+        // invert framebuffer y coordinate if vertical flipped
+        int16_t yf = (flags & FLIP_V) ? (y + ir.bottom - 1 - yi) : (y + yi - ir.top);
+        uint8_t* fb_ptr = linear_framebuffer + yf * linear_width + x;
+        if (reverse) {
+            // walk the framebuffer backwards
+            fb_ptr += width - 1;
+            for (int i = 0; i < width; i++) {
+                *fb_ptr = (*fb_ptr & ~(*hw_mask)) | (*hw_bitmap & *hw_mask);
+                hw_bitmap++;
+                hw_mask++;
+                fb_ptr--;
+            }
+        } else {
+            int i = 0;
+            for (; i + 4 <= width; i += 4) {
+                // in the framebuffer, replace masked bits with source image data
+                uint32_t fb, bitmap, mask;
+                memcpy(&fb, fb_ptr, 4);
+                memcpy(&bitmap, hw_bitmap, 4);
+                memcpy(&mask, hw_mask, 4);
+                fb = (fb & ~mask) | (bitmap & mask);
+                memcpy(fb_ptr, &fb, 4);
+                hw_bitmap += 4;
+                hw_mask += 4;
+                fb_ptr += 4;
+            }
+            for (; i < width; i++) {
+                *fb_ptr = (*fb_ptr & ~(*hw_mask)) | (*hw_bitmap & *hw_mask);
+                hw_bitmap++;
+                hw_mask++;
+                fb_ptr++;
+            }
+        }
+    }
+}
+
+static inline void linear_plot(int16_t x, int16_t y, uint8_t value)
+{
+    if ((x < 0) || (x >= linear_width) || (y < 0) || (y >= linear_height))
+        return;
+    linear_framebuffer[y * linear_width + x] = value;
+}
+
+void linear_blit_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint8_t value)
+{
+    if (!linear_framebuffer)
+        return;
+    dirty_log_line(x0, y0, x1, y1, value);
+
+    // bresenham line algorithm - borrowed from ScummVM's drawLine function
+    const bool steep = abs(y1 - y0) > abs(x1 - x0);
+
+    if (steep) {
+        int16_t tmp;
+        tmp = x0;
+        x0 = y0;
+        y0 = tmp;
+        tmp = x1;
+        x1 = y1;
+        y1 = tmp;
+    }
+
+    int16_t dx = abs(x1 - x0);
+    int16_t dy = abs(y1 - y0);
+    int16_t D = dy;
+    int16_t x = x0;
+    int16_t y = y0;
+    int16_t err = 0;
+    int16_t x_inc = (x0 < x1) ? 1 : -1;
+    int16_t y_inc = (y0 < y1) ? 1 : -1;
+
+    if (steep)
+        linear_plot(y, x, value);
+    else
+        linear_plot(x, y, value);
+
+    while (x != x1) {
+        x += x_inc;
+        err += D;
+        if (2 * err > dx) {
+            y += y_inc;
+            err -= dx;
+        }
+        if (steep)
+            linear_plot(y, x, value);
+        else
+            linear_plot(x, y, value);
+    }
+}
+
+pt_image_linear* linear_convert_image(pt_image* image)
+{
+    pt_image_linear* result = (pt_image_linear*)calloc(1, sizeof(pt_image_linear));
+    if (!result)
+        return NULL;
+    result->width = image->width;
+    result->height = image->height;
+    result->pitch = image->pitch;
+    result->bitmap = (byte*)calloc(result->pitch * result->height, sizeof(byte));
+    result->mask = (byte*)calloc(result->pitch * result->height, sizeof(byte));
+    if (!result->bitmap || !result->mask) {
+        linear_destroy_hw_image(result);
+        return NULL;
+    }
+
+    const byte* palette_map = image_palette_get_map(image->palette);
+    pt_dither_map* dither_map = image_palette_get_dither_map(image->palette);
+    palette_deps_init(&result->deps);
+
+    for (int y = 0; y < result->height; y++) {
+        for (int x = 0; x < result->width; x++) {
+            byte pixel = image->data[y * result->pitch + x];
+            result->bitmap[y * result->pitch + x] = dither_map->phase[dither_phase(x, y)][pixel];
+            if ((pixel == image->colourkey) || (image->palette->alpha[pixel] == 0x00)) {
+                result->mask[y * result->pitch + x] = 0x00;
+            } else {
+                result->mask[y * result->pitch + x] = 0xff;
+                palette_deps_add(&result->deps, palette_map[pixel]);
+            }
+        }
+    }
+
+    return result;
+}
+
+void linear_destroy_hw_image(void* hw_image)
+{
+    pt_image_linear* image = (pt_image_linear*)hw_image;
+    if (!image)
+        return;
+    if (image->bitmap) {
+        free(image->bitmap);
+        image->bitmap = NULL;
+    }
+    if (image->mask) {
+        free(image->mask);
+        image->mask = NULL;
+    }
+    if (image->bitmap_flipped) {
+        free(image->bitmap_flipped);
+        image->bitmap_flipped = NULL;
+    }
+    if (image->mask_flipped) {
+        free(image->mask_flipped);
+        image->mask_flipped = NULL;
+    }
+    free(image);
+}
+
+bool linear_save_layer()
+{
+    if (!linear_framebuffer)
+        return false;
+    if (!linear_layer) {
+        linear_layer = (byte*)malloc(linear_width * linear_height);
+        if (!linear_layer) {
+            log_print("linear_save_layer: out of memory\n");
+            return false;
+        }
+    }
+    memcpy(linear_layer, linear_framebuffer, linear_width * linear_height);
+    return true;
+}
+
+bool linear_restore_layer()
+{
+    if (!linear_framebuffer || !linear_layer)
+        return false;
+    memcpy(linear_framebuffer, linear_layer, linear_width * linear_height);
+    return true;
+}
+
+void linear_shutdown()
+{
+    if (linear_framebuffer) {
+        free(linear_framebuffer);
+        linear_framebuffer = NULL;
+    }
+    if (linear_layer) {
+        free(linear_layer);
+        linear_layer = NULL;
+    }
+    dirty_shutdown();
+}
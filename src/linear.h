@@ -0,0 +1,46 @@
+#ifndef PERENTIE_LINEAR_H
+#define PERENTIE_LINEAR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "system.h"
+
+// Software compositor for a linear 8-bit framebuffer.
+// Uses the same masked-blit approach as the DOS VGA driver,
+// but without the Mode X plane layout, so it can back any platform.
+
+typedef unsigned char byte;
+typedef struct pt_image pt_image;
+typedef struct pt_image_linear pt_image_linear;
+
+struct pt_image_linear {
+    byte* bitmap;
+    byte* mask;
+    uint16_t width;
+    uint16_t height;
+    uint16_t pitch;
+    pt_palette_deps deps;
+    // Mirrored copy of the bitmap and mask, made once the image has been
+    // drawn with FLIP_H often enough; flipped blits can then use the fast path
+    byte* bitmap_flipped;
+    byte* mask_flipped;
+    uint16_t flip_count;
+};
+
+// Number of flipped draws before an image gets a mirrored copy
+#define LINEAR_FLIP_CACHE_THRESHOLD 8
+
+bool linear_init(int16_t width, int16_t height);
+byte* linear_get_framebuffer();
+void linear_clear(uint8_t colour);
+void linear_blit_image(
+    pt_image* image, int16_t x, int16_t y, uint8_t flags, int16_t left, int16_t top, int16_t right, int16_t bottom);
+void linear_blit_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint8_t value);
+pt_image_linear* linear_convert_image(pt_image* image);
+void linear_destroy_hw_image(void* hw_image);
+bool linear_save_layer();
+bool linear_restore_layer();
+void linear_shutdown();
+
+#endif
@@ -7,6 +7,7 @@
 #include "colour.h"
 #include "event.h"
 #include "fs.h"
+#include "headless.h"
 #include "log.h"
 #include "musicrad.h"
 #include "pcspeak.h"
@@ -32,8 +33,23 @@ static uint32_t blits[16] = { 0 };
 static uint32_t flips[16] = { 0 };
 static uint32_t sample_idx = 0;
 
+// Headless benchmarking; wall clock totals for each stage of the loop
+static bool headless = false;
+static int frame_limit = 0;
+static int frame_total = 0;
+static uint64_t bench_micros[4] = { 0 };
+
+// Only list the options this build has; see the table in perentie_init
+#if defined(SYSTEM_SDL)
+#define USAGE_VIDEO_OPTIONS "[--software] [--modex] "
+#elif !defined(SYSTEM_DOS)
+#define USAGE_VIDEO_OPTIONS "[--modex] "
+#else
+#define USAGE_VIDEO_OPTIONS ""
+#endif
+
 static const char* const usages[] = {
-    "perentie [--version] [--debug] PATH [PATH ...]",
+    "perentie [--version] [--debug] " USAGE_VIDEO_OPTIONS "[--headless] [--frames N] PATH [PATH ...]",
     NULL,
 };
 
@@ -64,9 +80,24 @@ void perentie_init(int argc, const char** argv)
     const char* argv0 = argc > 0 ? argv[0] : "perentie";
     int version = 0;
     int log = 0;
-    struct argparse_option options[]
-        = { OPT_HELP(), OPT_BOOLEAN('v', "version", &version, "print version and exit", NULL, 0, 0),
-              OPT_BOOLEAN('l', "log", &log, "run with debug logging", NULL, 0, 0), OPT_END() };
+#ifdef SYSTEM_SDL
+    int software = 0;
+#endif
+#ifndef SYSTEM_DOS
+    int modex = 0;
+#endif
+    int use_headless = 0;
+    struct argparse_option options[] = { OPT_HELP(),
+        OPT_BOOLEAN('v', "version", &version, "print version and exit", NULL, 0, 0),
+        OPT_BOOLEAN('l', "log", &log, "run with debug logging", NULL, 0, 0),
+#ifdef SYSTEM_SDL
+        OPT_BOOLEAN('s', "software", &software, "use the software renderer", NULL, 0, 0),
+#endif
+#ifndef SYSTEM_DOS
+        OPT_BOOLEAN(0, "modex", &modex, "use the DOS renderer with an emulated VGA card", NULL, 0, 0),
+#endif
+        OPT_BOOLEAN(0, "headless", &use_headless, "run without display, audio or input", NULL, 0, 0),
+        OPT_INTEGER(0, "frames", &frame_limit, "quit after running N frames", NULL, 0, 0), OPT_END() };
     struct argparse argparse;
     argparse_init(&argparse, options, usages, 0);
     argc = argparse_parse(&argparse, argc, argv);
@@ -74,6 +105,27 @@ void perentie_init(int argc, const char** argv)
         printf("Perentie %s (%s)\n", VERSION, PLATFORM);
         exit(0);
     }
+#ifdef SYSTEM_SDL
+    if (software)
+        pt_sys.video = &sdl_video_soft;
+    if (modex)
+        pt_sys.video = &sdl_video_modex;
+#endif
+    if (use_headless) {
+        headless = true;
+        pt_sys.app = &headless_app;
+        pt_sys.timer = &headless_timer;
+        pt_sys.keyboard = &headless_keyboard;
+        pt_sys.mouse = &headless_mouse;
+        pt_sys.serial = &headless_serial;
+        pt_sys.opl = &headless_opl;
+        pt_sys.beep = &headless_beep;
+#ifndef SYSTEM_DOS
+        pt_sys.video = modex ? &headless_video_modex : &headless_video;
+#else
+        pt_sys.video = &headless_video;
+#endif
+    }
 
     // seed the RNG in the most basic way
     srand(time(NULL));
@@ -136,18 +188,41 @@ void perentie_shutdown()
     fs_shutdown();
 }
 
+static void perentie_bench(int stage, uint64_t* wall)
+{
+    if (!headless)
+        return;
+    uint64_t now = headless_wall_micros();
+    bench_micros[stage] += now - *wall;
+    *wall = now;
+}
+
+static void perentie_bench_report()
+{
+    if (!headless || !frame_total)
+        return;
+    uint64_t total = bench_micros[0] + bench_micros[1] + bench_micros[2] + bench_micros[3];
+    printf("Ran %d frames in %llu us (%llu us/frame)\n", frame_total, (unsigned long long)total,
+        (unsigned long long)(total / frame_total));
+    printf("Average times (us): logic %llu, FB draw %llu, FB copy %llu, flip %llu\n",
+        (unsigned long long)(bench_micros[0] / frame_total), (unsigned long long)(bench_micros[1] / frame_total),
+        (unsigned long long)(bench_micros[2] / frame_total), (unsigned long long)(bench_micros[3] / frame_total));
+}
+
 static void perentie_loop()
 {
     // Main löp
-    if (script_has_quit()) {
+    if (script_has_quit() || (frame_limit > 0 && frame_total >= frame_limit)) {
+        perentie_bench_report();
         perentie_shutdown();
 #ifdef __EMSCRIPTEN__
         emscripten_cancel_main_loop(); /* this should "kill" the app. */
         return;
 #else
-        exit(script_quit_status());
+        exit(script_has_quit() ? script_quit_status() : 0);
 #endif
     }
+    uint64_t wall = headless ? headless_wall_micros() : 0;
     uint32_t ticks = pt_sys.timer->millis();
     // Run Lua coroutines for 1 step
     script_exec();
@@ -156,17 +231,22 @@ static void perentie_loop()
     pt_sys.mouse->update();
     // Process input events in Lua
     script_events();
+    // Step any palette cycles and fades
+    palette_update_effects(pt_sys.timer->millis());
     samples[sample_idx] = pt_sys.timer->millis() - ticks;
+    perentie_bench(0, &wall);
 
     ticks = pt_sys.timer->millis();
     // Run Lua routine for drawing graphics to framebuffer
     script_render();
     draws[sample_idx] = pt_sys.timer->millis() - ticks;
+    perentie_bench(1, &wall);
 
     ticks = pt_sys.timer->millis();
     // Copy framebuffer to video memory
     pt_sys.video->blit();
     blits[sample_idx] = pt_sys.timer->millis() - ticks;
+    perentie_bench(2, &wall);
 
     // Deal with input from the serial debug console
     script_repl();
@@ -175,7 +255,9 @@ static void perentie_loop()
     // Flip the video page and sync to display refresh rate
     pt_sys.video->flip();
     flips[sample_idx] = pt_sys.timer->millis() - ticks;
+    perentie_bench(3, &wall);
     sample_idx = (sample_idx + 1) % 16;
+    frame_total++;
 }
 
 int main(int argc, const char** argv)
@@ -0,0 +1,356 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "colour.h"
+#include "dirty.h"
+#include "image.h"
+#include "log.h"
+#include "modex.h"
+#include "planar.h"
+#include "rect.h"
+#include "utils.h"
+
+// Lookup table for converting 8-bit colour components to 6-bit VGA DAC values
+// clang-format off
+uint8_t modex_remap[256] = {
+    0x00, 0x00, 0x00, 0x01, 0x01, 0x01, 0x01, 0x02,
+    0x02, 0x02, 0x02, 0x03, 0x03, 0x03, 0x03, 0x04,
+    0x04, 0x04, 0x04, 0x05, 0x05, 0x05, 0x05, 0x06,
+    0x06, 0x06, 0x06, 0x07, 0x07, 0x07, 0x07, 0x08,
+    0x08, 0x08, 0x08, 0x09, 0x09, 0x09, 0x09, 0x0a,
+    0x0a, 0x0a, 0x0a, 0x0b, 0x0b, 0x0b, 0x0b, 0x0c,
+    0x0c, 0x0c, 0x0c, 0x0d, 0x0d, 0x0d, 0x0d, 0x0e,
+    0x0e, 0x0e, 0x0e, 0x0f, 0x0f, 0x0f, 0x0f, 0x10,
+    0x10, 0x10, 0x10, 0x11, 0x11, 0x11, 0x11, 0x12,
+    0x12, 0x12, 0x12, 0x13, 0x13, 0x13, 0x13, 0x14,
+    0x14, 0x14, 0x14, 0x15, 0x15, 0x15, 0x15, 0x15,
+    0x16, 0x16, 0x16, 0x16, 0x17, 0x17, 0x17, 0x17,
+    0x18, 0x18, 0x18, 0x18, 0x19, 0x19, 0x19, 0x19,
+    0x1a, 0x1a, 0x1a, 0x1a, 0x1b, 0x1b, 0x1b, 0x1b,
+    0x1c, 0x1c, 0x1c, 0x1c, 0x1d, 0x1d, 0x1d, 0x1d,
+    0x1e, 0x1e, 0x1e, 0x1e, 0x1f, 0x1f, 0x1f, 0x1f,
+    0x20, 0x20, 0x20, 0x20, 0x21, 0x21, 0x21, 0x21,
+    0x22, 0x22, 0x22, 0x22, 0x23, 0x23, 0x23, 0x23,
+    0x24, 0x24, 0x24, 0x24, 0x25, 0x25, 0x25, 0x25,
+    0x26, 0x26, 0x26, 0x26, 0x27, 0x27, 0x27, 0x27,
+    0x28, 0x28, 0x28, 0x28, 0x29, 0x29, 0x29, 0x29,
+    0x2a, 0x2a, 0x2a, 0x2a, 0x2a, 0x2b, 0x2b, 0x2b,
+    0x2b, 0x2c, 0x2c, 0x2c, 0x2c, 0x2d, 0x2d, 0x2d,
+    0x2d, 0x2e, 0x2e, 0x2e, 0x2e, 0x2f, 0x2f, 0x2f,
+    0x2f, 0x30, 0x30, 0x30, 0x30, 0x31, 0x31, 0x31,
+    0x31, 0x32, 0x32, 0x32, 0x32, 0x33, 0x33, 0x33,
+    0x33, 0x34, 0x34, 0x34, 0x34, 0x35, 0x35, 0x35,
+    0x35, 0x36, 0x36, 0x36, 0x36, 0x37, 0x37, 0x37,
+    0x37, 0x38, 0x38, 0x38, 0x38, 0x39, 0x39, 0x39,
+    0x39, 0x3a, 0x3a, 0x3a, 0x3a, 0x3b, 0x3b, 0x3b,
+    0x3b, 0x3c, 0x3c, 0x3c, 0x3c, 0x3d, 0x3d, 0x3d,
+    0x3d, 0x3e, 0x3e, 0x3e, 0x3e, 0x3f, 0x3f, 0x3f
+};
+
+// clang-format on
+
+static pt_modex_hal* modex_hal = NULL;
+
+static byte modex_palette[256 * 3] = { 0 };
+
+static byte* modex_framebuffer = NULL;
+
+static byte* modex_layer = NULL;
+
+static int modex_page_offset = 0;
+
+static bool modex_first_flip = false;
+static bool modex_palette_update = true;
+static bool modex_overscan_update = false;
+static uint8_t modex_overscan = 0x00;
+
+bool modex_init(pt_modex_hal* hal)
+{
+    if (modex_framebuffer)
+        return true;
+    if (!hal || !hal->init()) {
+        log_print("modex_init: Failed to init video hardware\n");
+        return false;
+    }
+    modex_hal = hal;
+
+    modex_framebuffer = (byte*)calloc(MODEX_WIDTH * MODEX_HEIGHT, sizeof(byte));
+    dirty_init(MODEX_WIDTH, MODEX_HEIGHT);
+
+    for (int i = 0; i < pt_sys.palette_top; i++) {
+        modex_palette[3 * i] = modex_remap[pt_sys.palette_display[i].r];
+        modex_palette[3 * i + 1] = modex_remap[pt_sys.palette_display[i].g];
+        modex_palette[3 * i + 2] = modex_remap[pt_sys.palette_display[i].b];
+    }
+
+    modex_page_offset = 0;
+    modex_first_flip = true;
+    return true;
+}
+
+void modex_shutdown()
+{
+    if (modex_hal) {
+        modex_hal->shutdown();
+        modex_hal = NULL;
+    }
+    if (modex_framebuffer) {
+        free(modex_framebuffer);
+        modex_framebuffer = NULL;
+    }
+    if (modex_layer) {
+        free(modex_layer);
+        modex_layer = NULL;
+    }
+    dirty_shutdown();
+}
+
+void modex_clear()
+{
+    if (!modex_framebuffer)
+        return;
+    memset(modex_framebuffer, pt_sys.overscan, MODEX_WIDTH * MODEX_HEIGHT);
+    dirty_log_clear(pt_sys.overscan);
+}
+
+bool modex_save_layer()
+{
+    if (!modex_framebuffer)
+        return false;
+    if (!modex_layer) {
+        modex_layer = (byte*)malloc(MODEX_WIDTH * MODEX_HEIGHT);
+        if (!modex_layer) {
+            log_print("modex_save_layer: out of memory\n");
+            return false;
+        }
+    }
+    memcpy(modex_layer, modex_framebuffer, MODEX_WIDTH * MODEX_HEIGHT);
+    return true;
+}
+
+bool modex_restore_layer()
+{
+    if (!modex_framebuffer || !modex_layer)
+        return false;
+    memcpy(modex_framebuffer, modex_layer, MODEX_WIDTH * MODEX_HEIGHT);
+    return true;
+}
+
+void modex_blit_image(
+    pt_image* image, int16_t x, int16_t y, uint8_t flags, int16_t left, int16_t top, int16_t right, int16_t bottom)
+{
+    if (!modex_framebuffer) {
+        log_print("modex_blit_image: driver not inited!\n");
+        return;
+    }
+    planar_blit_image(modex_framebuffer, MODEX_WIDTH, MODEX_HEIGHT, image, x, y, flags, left, top, right, bottom);
+}
+
+static void modex_load_palette()
+{
+    for (int i = 0; i < 256; i++) {
+        modex_hal->set_dac(i, modex_palette[3 * i], modex_palette[3 * i + 1], modex_palette[3 * i + 2]);
+    }
+}
+
+void modex_update_palette_slot(uint8_t idx)
+{
+    byte r = pt_sys.palette_display[idx].r;
+    byte g = pt_sys.palette_display[idx].g;
+    byte b = pt_sys.palette_display[idx].b;
+    byte r_v = modex_remap[r];
+    byte g_v = modex_remap[g];
+    byte b_v = modex_remap[b];
+    modex_palette[3 * idx] = r_v;
+    modex_palette[3 * idx + 1] = g_v;
+    modex_palette[3 * idx + 2] = b_v;
+    modex_palette_update = true;
+}
+
+static void modex_plot(int16_t x, int16_t y, uint8_t value)
+{
+    if ((x < 0) || (x >= MODEX_WIDTH) || (y < 0) || (y >= MODEX_HEIGHT))
+        return;
+    if (!modex_framebuffer)
+        return;
+    *(modex_framebuffer + ((x % 4) * MODEX_PLANE) + (y * (MODEX_WIDTH >> 2)) + (x >> 2)) = value;
+}
+
+void modex_blit_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, pt_colour_rgb* colour)
+{
+    // bresenham line algorithm - borrowed from ScummVM's drawLine function
+    const bool steep = abs(y1 - y0) > abs(x1 - x0);
+
+    if (steep) {
+        int16_t tmp;
+        tmp = x0;
+        x0 = y0;
+        y0 = tmp;
+        tmp = x1;
+        x1 = y1;
+        y1 = tmp;
+    }
+
+    int16_t dx = abs(x1 - x0);
+    int16_t dy = abs(y1 - y0);
+    int16_t D = dy;
+    int16_t x = x0;
+    int16_t y = y0;
+    int16_t err = 0;
+    int16_t x_inc = (x0 < x1) ? 1 : -1;
+    int16_t y_inc = (y0 < y1) ? 1 : -1;
+
+    uint8_t value = map_colour(colour->r, colour->g, colour->b);
+    if (steep)
+        dirty_log_line(y0, x0, y1, x1, value);
+    else
+        dirty_log_line(x0, y0, x1, y1, value);
+
+    if (steep)
+        modex_plot(y, x, value);
+    else
+        modex_plot(x, y, value);
+
+    while (x != x1) {
+        x += x_inc;
+        err += D;
+        if (2 * err > dx) {
+            y += y_inc;
+            err -= dx;
+        }
+        if (steep)
+            modex_plot(y, x, value);
+        else
+            modex_plot(x, y, value);
+    }
+}
+
+void modex_blit()
+{
+    // copy the framebuffer to VGA memory
+    if (!modex_framebuffer)
+        return;
+
+    if (modex_first_flip) {
+        modex_hal->set_overscan(modex_overscan);
+        modex_load_palette();
+        modex_first_flip = false;
+    }
+
+    // Only copy the areas which differ from what's in the back page.
+    // The back page is two frames old, so include the previous frame's changes.
+    struct rect* rects = NULL;
+    size_t rect_count = dirty_end_frame(2, &rects);
+    if (!rect_count)
+        return;
+
+    modex_hal->begin_write();
+    for (int p = 0; p < 4; p++) {
+        byte* buf = modex_framebuffer + p * MODEX_PLANE;
+        for (size_t i = 0; i < rect_count; i++) {
+            // Plane columns covering the rectangle
+            int16_t left = rects[i].left >> 2;
+            int16_t right = (rects[i].right + 3) >> 2;
+            int16_t top = rects[i].top;
+            int16_t bottom = rects[i].bottom;
+            if ((left == 0) && (right == (MODEX_WIDTH >> 2))) {
+                // Full width, so the span is contiguous
+                modex_hal->write_plane(p, modex_page_offset + top * (MODEX_WIDTH >> 2), buf + top * (MODEX_WIDTH >> 2),
+                    (bottom - top) * (MODEX_WIDTH >> 2));
+                continue;
+            }
+            for (int y = top; y < bottom; y++) {
+                modex_hal->write_plane(p, modex_page_offset + y * (MODEX_WIDTH >> 2) + left,
+                    buf + y * (MODEX_WIDTH >> 2) + left, right - left);
+            }
+        }
+    }
+    modex_hal->end_write();
+}
+
+static int frame_count = 0;
+
+void modex_flip()
+{
+    if (!modex_framebuffer)
+        return;
+
+    // Do not yield in the busy-loops.
+    // Yielding here causes massive lag under Windows 98,
+    // and no other games seem to do it.
+
+    // Flipping the screen page in DOS is a big ordeal.
+    // Why? Well, the start address gets latched exactly once,
+    // at the start of the vblank interval.
+    // Which means as soon as we detect a vblank it's too late,
+    // the screen will have already torn.
+
+    // The below has been fleshed out through trial and error on
+    // real hardware. DOSBox will not show you screen tearing.
+
+    // Flip page by setting the CRTC data address to the
+    // area of VGA memory we just wrote to with modex_blit()
+    // uint32_t ticks = pt_sys.timer->ticks();
+    modex_hal->set_start_address(modex_page_offset);
+    // uint32_t flip_wait = pt_sys.timer->ticks() - ticks;
+
+    // Swap the VGA offset used for writes to the other
+    // region of memory
+    modex_page_offset = (modex_page_offset > 0) ? 0 : MODEX_PLANE;
+
+    // Now that the page is flipped, resynchronise to after the vblank.
+
+    // Wait until the start of the vertical blanking interval
+    // ticks = pt_sys.timer->ticks();
+    do {
+    } while (!modex_hal->is_vblank());
+    // uint32_t vblankstart = pt_sys.timer->ticks() - ticks;
+
+    // Wait until vblank is over
+    // ticks = pt_sys.timer->ticks();
+    do {
+    } while (modex_hal->is_vblank());
+    // uint32_t vblankend = pt_sys.timer->ticks() - ticks;
+
+    if (modex_overscan_update) {
+        modex_hal->set_overscan(modex_overscan);
+        modex_overscan_update = false;
+    }
+    if (modex_palette_update) {
+        modex_load_palette();
+    }
+
+    // A little yield as a treat
+    modex_hal->yield();
+
+    frame_count += 1;
+    // if ((frame_count % 100) == 0)
+    //     log_print("modex_blit: flip %d vblankstart %d vblankend %d\n", flip_wait, vblankstart,
+    //     vblankend);
+}
+
+void modex_set_palette_remapper(enum pt_palette_remapper remapper, enum pt_palette_remapper_mode mode)
+{
+    palette_set_remapper(remapper, mode);
+}
+
+void modex_set_overscan_colour(pt_colour_rgb* colour)
+{
+    pt_colour_rgb target = { 0x00, 0x00, 0x00 };
+    if (colour) {
+        target.r = colour->r;
+        target.g = colour->g;
+        target.b = colour->b;
+    }
+    modex_overscan = map_colour(target.r, target.g, target.b);
+    // Defer actual command so there isn't a gap between the
+    // page flip and the border change.
+    modex_overscan_update = true;
+}
+
+void modex_get_screen_dims(uint16_t* w, uint16_t* h)
+{
+    *w = MODEX_WIDTH;
+    *h = MODEX_HEIGHT;
+}
@@ -0,0 +1,59 @@
+#ifndef PERENTIE_MODEX_H
+#define PERENTIE_MODEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "system.h"
+
+// Mode X video pipeline: images are composited into an off-screen planar
+// framebuffer, the changed areas are copied plane by plane into the back page
+// of video memory, then the pages are flipped. The parts that touch the
+// VGA hardware go through a pt_modex_hal, so the same pipeline can drive
+// a real card (dos_vga.c) or an emulated one (vgaemu.c).
+
+#define MODEX_WIDTH 320
+#define MODEX_HEIGHT 200
+#define MODEX_PLANE ((MODEX_WIDTH * MODEX_HEIGHT) >> 2)
+
+typedef unsigned char byte;
+typedef struct pt_modex_hal pt_modex_hal;
+
+struct pt_modex_hal {
+    // Switch to Mode X with all of video memory cleared
+    bool (*init)();
+    // Switch back to text mode
+    void (*shutdown)();
+    // Bracket a batch of writes to video memory
+    void (*begin_write)();
+    void (*end_write)();
+    // Copy a run of bytes into one plane of video memory
+    void (*write_plane)(uint8_t plane, uint16_t offset, const byte* src, uint16_t length);
+    // Set the CRTC start address, i.e. the page to display from the next frame
+    void (*set_start_address)(uint16_t offset);
+    bool (*is_vblank)();
+    // Set a DAC palette entry, using 6-bit components
+    void (*set_dac)(uint8_t idx, uint8_t r, uint8_t g, uint8_t b);
+    void (*set_overscan)(uint8_t idx);
+    // Give some time back to the host at the end of a frame
+    void (*yield)();
+};
+
+extern uint8_t modex_remap[256];
+
+bool modex_init(pt_modex_hal* hal);
+void modex_shutdown();
+void modex_clear();
+void modex_blit_image(
+    pt_image* image, int16_t x, int16_t y, uint8_t flags, int16_t left, int16_t top, int16_t right, int16_t bottom);
+void modex_blit_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, pt_colour_rgb* colour);
+void modex_blit();
+void modex_flip();
+void modex_update_palette_slot(uint8_t idx);
+void modex_set_palette_remapper(enum pt_palette_remapper remapper, enum pt_palette_remapper_mode mode);
+void modex_set_overscan_colour(pt_colour_rgb* colour);
+void modex_get_screen_dims(uint16_t* w, uint16_t* h);
+bool modex_save_layer();
+bool modex_restore_layer();
+
+#endif
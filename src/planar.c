@@ -0,0 +1,224 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "colour.h"
+#include "dirty.h"
+#include "image.h"
+#include "log.h"
+#include "planar.h"
+#include "rect.h"
+#include "utils.h"
+
+static inline void planar_copy_reversed(byte* dest, const byte* src, int length)
+{
+    // dest points to the last byte of the run, and is walked backwards
+    for (; length >= 4; length -= 4) {
+        uint32_t data;
+        memcpy(&data, src, 4);
+        data = (data >> 24) | ((data >> 8) & 0x0000ff00) | ((data << 8) & 0x00ff0000) | (data << 24);
+        memcpy(dest - 3, &data, 4);
+        src += 4;
+        dest -= 4;
+    }
+    for (; length > 0; length--) {
+        *dest = *src;
+        src++;
+        dest--;
+    }
+}
+
+void planar_blit_image(byte* framebuffer, int16_t fb_width, int16_t fb_height, pt_image* image, int16_t x, int16_t y,
+    uint8_t flags, int16_t left, int16_t top, int16_t right, int16_t bottom)
+{
+    if (!framebuffer) {
+        log_print("planar_blit_image: framebuffer is NULL!\n");
+        return;
+    }
+    if (!image) {
+        log_print("planar_blit_image: image is NULL!\n");
+        return;
+    }
+
+    if (image->hw_image && !palette_deps_current(&((pt_image_planar*)image->hw_image)->deps)) {
+        planar_destroy_hw_image(image->hw_image);
+        image->hw_image = NULL;
+    }
+
+    if (!image->hw_image) {
+        image->hw_image = (void*)planar_convert_image(image);
+        if (!image->hw_image) {
+            log_error("planar_blit_image: failed to create hardware image for %s\n", image->path);
+            return;
+        }
+    }
+
+    pt_image_planar* hw_image = (pt_image_planar*)image->hw_image;
+
+    struct rect ir = { MIN(image->width, MAX(0, left)), MIN(image->height, MAX(0, top)),
+        MIN(image->width, MAX(0, right)), MIN(image->height, MAX(0, bottom)) };
+
+    struct rect crop = { 0, 0, fb_width, fb_height };
+
+    // Constrain x and y to be an absolute start offset in screen space.
+    // Crop the image rectangle, based on its location in screen space.
+    if (!rect_blit_clip(&x, &y, &ir, &crop)) {
+        return;
+    }
+    dirty_log_image(image, &ir, x, y, flags);
+
+    // after the image rect has been clipped, flip it if required
+    if (flags & FLIP_H) {
+        int16_t tmp = ir.right;
+        ir.right = hw_image->width - ir.left;
+        ir.left = hw_image->width - tmp;
+    }
+
+    if (flags & FLIP_V) {
+        int16_t tmp = ir.bottom;
+        ir.bottom = hw_image->height - ir.top;
+        ir.top = hw_image->height - tmp;
+    }
+
+    // The image rectangle is now in source image space, and is drawn so that
+    // source column ir.left lands on screen column x (or ir.right - 1, if flipped).
+    // Every 4th source column shares a plane, and so does every 4th screen column;
+    // that means each source plane maps onto exactly one framebuffer plane.
+    int16_t fb_pitch = fb_width >> 2;
+    int32_t fb_plane = (int32_t)fb_pitch * fb_height;
+    for (int pi = 0; pi < 4; pi++) {
+        // range of columns in the source plane, i.e. the source columns n >= ir.left where n % 4 == pi
+        int16_t ir_left = (ir.left + 3 - pi) >> 2;
+        int16_t ir_right = (ir.right + 3 - pi) >> 2;
+        if (ir_right <= ir_left)
+            continue;
+        // screen column of the first source column in the plane
+        int16_t sx = (ir_left << 2) + pi;
+        int16_t dx = (flags & FLIP_H) ? (x + ir.right - 1 - sx) : (x + sx - ir.left);
+        // destination plane and column in the framebuffer.
+        // moving along the source plane moves by 4 screen pixels, i.e. 1 framebuffer column
+        byte* fb_base = framebuffer + (dx & 3) * fb_plane + (dx >> 2);
+
+        pt_image_planar_row* rows = hw_image->rows + pi * hw_image->height;
+        for (int yi = ir.top; yi < ir.bottom; yi++) {
+            pt_image_planar_row* row = &rows[yi];
+            uint16_t* span = hw_image->spans + 2 * row->span;
+            uint16_t* span_end = span + 2 * row->span_count;
+            byte* hw_bitmap = hw_image->bitmap + row->data;
+            // invert framebuffer y coordinate if vertical flipped
+            int16_t yf = (flags & FLIP_V) ? (y + ir.bottom - 1 - yi) : (y + yi - ir.top);
+            byte* fb_ptr = fb_base + yf * fb_pitch;
+
+            // walk the spans, copying the parts of each opaque run inside the image rectangle
+            int16_t xi = 0;
+            while ((span < span_end) && (xi < ir_right)) {
+                xi += span[0];
+                int16_t start = MAX(xi, ir_left);
+                int16_t end = MIN(xi + span[1], ir_right);
+                if (start < end) {
+                    byte* src = hw_bitmap + (start - xi);
+                    if (flags & FLIP_H) {
+                        // invert framebuffer x position if horizontal flipped
+                        planar_copy_reversed(fb_ptr - (start - ir_left), src, end - start);
+                    } else {
+                        memcpy(fb_ptr + (start - ir_left), src, end - start);
+                    }
+                }
+                hw_bitmap += span[1];
+                xi += span[1];
+                span += 2;
+            }
+        }
+    }
+}
+
+pt_image_planar* planar_convert_image(pt_image* image)
+{
+    pt_image_planar* result = (pt_image_planar*)calloc(1, sizeof(pt_image_planar));
+    if (!result)
+        return NULL;
+    result->width = image->width;
+    result->height = image->height;
+    result->pitch = image->pitch;
+    result->plane_pitch = (image->pitch) >> 2;
+    // Allocate for the worst case (alternating single pixels), then shrink to fit
+    size_t max_spans = 4 * (size_t)result->height * ((result->plane_pitch >> 1) + 1);
+    result->bitmap = (byte*)calloc(result->pitch * result->height, sizeof(byte));
+    result->spans = (uint16_t*)calloc(2 * max_spans, sizeof(uint16_t));
+    result->rows = (pt_image_planar_row*)calloc(4 * result->height, sizeof(pt_image_planar_row));
+    if (!result->bitmap || !result->spans || !result->rows) {
+        planar_destroy_hw_image(result);
+        return NULL;
+    }
+
+    const byte* palette_map = image_palette_get_map(image->palette);
+    pt_dither_map* dither_map = image_palette_get_dither_map(image->palette);
+    palette_deps_init(&result->deps);
+
+    uint32_t data = 0;
+    uint32_t span = 0;
+    for (int p = 0; p < 4; p++) {
+        for (int y = 0; y < result->height; y++) {
+            pt_image_planar_row* row = &result->rows[p * result->height + y];
+            // Every pixel in a plane row has the same place in the dither pattern
+            byte* row_map = dither_map->phase[dither_phase(p, y)];
+            row->span = span;
+            row->data = data;
+            int x = 0;
+            while (x < result->plane_pitch) {
+                uint16_t skip = 0;
+                uint16_t count = 0;
+                for (; x < result->plane_pitch; x++) {
+                    byte pixel = image->data[y * result->pitch + (x << 2) + p];
+                    if ((pixel != image->colourkey) && (image->palette->alpha[pixel] != 0x00))
+                        break;
+                    skip++;
+                }
+                for (; x < result->plane_pitch; x++) {
+                    byte pixel = image->data[y * result->pitch + (x << 2) + p];
+                    if ((pixel == image->colourkey) || (image->palette->alpha[pixel] == 0x00))
+                        break;
+                    result->bitmap[data] = row_map[pixel];
+                    palette_deps_add(&result->deps, palette_map[pixel]);
+                    data++;
+                    count++;
+                }
+                // trailing transparent pixels don't need a span
+                if (!count)
+                    break;
+                result->spans[2 * span] = skip;
+                result->spans[2 * span + 1] = count;
+                span++;
+                row->span_count++;
+            }
+        }
+    }
+
+    byte* bitmap = (byte*)realloc(result->bitmap, MAX(data, 1) * sizeof(byte));
+    if (bitmap)
+        result->bitmap = bitmap;
+    uint16_t* spans = (uint16_t*)realloc(result->spans, MAX(2 * span, 1) * sizeof(uint16_t));
+    if (spans)
+        result->spans = spans;
+
+    return result;
+}
+
+void planar_destroy_hw_image(void* hw_image)
+{
+    pt_image_planar* image = (pt_image_planar*)hw_image;
+    if (!image)
+        return;
+    if (image->bitmap) {
+        free(image->bitmap);
+        image->bitmap = NULL;
+    }
+    if (image->spans) {
+        free(image->spans);
+        image->spans = NULL;
+    }
+    if (image->rows) {
+        free(image->rows);
+        image->rows = NULL;
+    }
+    free(image);
+}
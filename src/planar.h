@@ -0,0 +1,47 @@
+#ifndef PERENTIE_PLANAR_H
+#define PERENTIE_PLANAR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "system.h"
+
+// Software compositor for a Mode X style planar 8-bit framebuffer.
+// The framebuffer is split into 4 planes, one after the other; pixel (x, y)
+// lives in plane (x % 4), at byte (y * width / 4 + x / 4) of that plane.
+// Nothing in here touches the hardware, so it can be used on any platform.
+
+typedef unsigned char byte;
+typedef struct pt_image pt_image;
+typedef struct pt_image_planar pt_image_planar;
+typedef struct pt_image_planar_row pt_image_planar_row;
+
+// Each row of each plane is stored as a list of spans; a span is a pair of
+// run lengths, the number of transparent pixels to skip followed by the
+// number of opaque pixels to copy. Only the opaque pixels are kept.
+struct pt_image_planar_row {
+    // Offset of the first span in pt_image_planar.spans
+    uint32_t span;
+    // Offset of the first opaque pixel in pt_image_planar.bitmap
+    uint32_t data;
+    uint16_t span_count;
+};
+
+struct pt_image_planar {
+    byte* bitmap;
+    uint16_t* spans;
+    // Row index, plane-major (i.e. rows[plane * height + y])
+    pt_image_planar_row* rows;
+    uint16_t width;
+    uint16_t height;
+    uint16_t pitch;
+    uint16_t plane_pitch;
+    pt_palette_deps deps;
+};
+
+void planar_blit_image(byte* framebuffer, int16_t fb_width, int16_t fb_height, pt_image* image, int16_t x, int16_t y,
+    uint8_t flags, int16_t left, int16_t top, int16_t right, int16_t bottom);
+pt_image_planar* planar_convert_image(pt_image* image);
+void planar_destroy_hw_image(void* hw_image);
+
+#endif
@@ -0,0 +1,655 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua/lauxlib.h"
+#include "lua/lua.h"
+
+#include "dirty.h"
+#include "image.h"
+#include "log.h"
+#include "scene.h"
+#include "system.h"
+#include "text.h"
+
+static pt_scene scenes[SCENE_MAX] = { 0 };
+
+typedef struct pt_scene_key pt_scene_key;
+typedef struct pt_scene_layer pt_scene_layer;
+typedef struct pt_scene_frame pt_scene_frame;
+
+// Everything a run of objects would draw; image serials, positions and flags
+struct pt_scene_key {
+    int32_t* values;
+    size_t count;
+    size_t size;
+    bool failed;
+};
+
+// Cached composite of the static objects at the bottom of the room.
+// Kept by the video driver as a copy of the whole framebuffer, so it is
+// only good if the frame was started the same way, and the objects
+// would draw exactly the same thing.
+struct pt_scene_layer {
+    pt_scene_key key;
+    // Dirty ops logged before the room was drawn
+    pt_dirty_op* before;
+    size_t before_count;
+    size_t before_size;
+    // Dirty ops logged by drawing the static objects
+    pt_dirty_op* ops;
+    size_t op_count;
+    size_t op_size;
+    bool valid;
+};
+
+static pt_scene_layer scene_layer = { 0 };
+static pt_scene_key scene_key = { 0 };
+
+struct pt_scene_frame {
+    lua_State* L;
+    // If set, record what would be drawn instead of drawing it
+    pt_scene_key* key;
+    bool room;
+    lua_Number room_x;
+    lua_Number room_y;
+    lua_Number origin_x;
+    lua_Number origin_y;
+    lua_Integer millis;
+};
+
+static lua_Number scene_get_number(lua_State* L, int idx, const char* key, lua_Number fallback)
+{
+    lua_getfield(L, idx, key);
+    lua_Number result = lua_isnumber(L, -1) ? lua_tonumber(L, -1) : fallback;
+    lua_pop(L, 1);
+    return result;
+}
+
+static lua_Integer scene_get_integer(lua_State* L, int idx, const char* key, lua_Integer fallback)
+{
+    lua_getfield(L, idx, key);
+    lua_Integer result = lua_isnumber(L, -1) ? lua_tointeger(L, -1) : fallback;
+    lua_pop(L, 1);
+    return result;
+}
+
+static bool scene_get_bool(lua_State* L, int idx, const char* key)
+{
+    lua_getfield(L, idx, key);
+    bool result = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+    return result;
+}
+
+static enum pt_scene_node_type scene_node_type(lua_State* L, int idx)
+{
+    enum pt_scene_node_type result = 0;
+    lua_getfield(L, idx, "_type");
+    const char* type = lua_tostring(L, -1);
+    if (!type) {
+    } else if (strcmp(type, "PTBackground") == 0) {
+        result = SCENE_NODE_BACKGROUND;
+    } else if (strcmp(type, "PTSprite") == 0) {
+        result = SCENE_NODE_SPRITE;
+    } else if (strcmp(type, "PTActor") == 0) {
+        result = SCENE_NODE_ACTOR;
+    } else if (strcmp(type, "PTGroup") == 0) {
+        result = SCENE_NODE_GROUP;
+    } else if (strcmp(type, "PTPanel") == 0) {
+        result = SCENE_NODE_PANEL;
+    } else if (strcmp(type, "PTButton") == 0) {
+        result = SCENE_NODE_BUTTON;
+    } else if (strcmp(type, "PTHorizSlider") == 0) {
+        result = SCENE_NODE_SLIDER;
+    }
+    lua_pop(L, 1);
+    return result;
+}
+
+static bool scene_reserve(void** items, size_t* size, size_t count, size_t item_size)
+{
+    if (count <= *size)
+        return true;
+    size_t new_size = *size ? *size : 64;
+    while (new_size < count)
+        new_size *= 2;
+    void* result = realloc(*items, item_size * new_size);
+    if (!result) {
+        log_print("scene_reserve: out of memory\n");
+        return false;
+    }
+    *items = result;
+    *size = new_size;
+    return true;
+}
+
+static void scene_key_push(pt_scene_key* key, int32_t value)
+{
+    if (key->failed || !scene_reserve((void**)&key->values, &key->size, key->count + 1, sizeof(int32_t))) {
+        key->failed = true;
+        return;
+    }
+    key->values[key->count] = value;
+    key->count++;
+}
+
+static inline bool scene_node_has_children(pt_scene_node* node)
+{
+    return node->type >= SCENE_NODE_GROUP;
+}
+
+static void scene_clear(lua_State* L, pt_scene* scene)
+{
+    if (L && scene->valid) {
+        for (size_t i = 0; i < scene->count; i++) {
+            luaL_unref(L, LUA_REGISTRYINDEX, scene->nodes[i].ref);
+        }
+        luaL_unref(L, LUA_REGISTRYINDEX, scene->list_ref);
+    }
+    scene->count = 0;
+    scene->list_ref = LUA_NOREF;
+    scene->list = NULL;
+    scene->list_len = 0;
+    scene->valid = false;
+}
+
+static pt_scene_node* scene_add_node(pt_scene* scene)
+{
+    if (scene->count == scene->size) {
+        size_t size = scene->size ? scene->size * 2 : 64;
+        pt_scene_node* nodes = (pt_scene_node*)realloc(scene->nodes, sizeof(pt_scene_node) * size);
+        if (!nodes) {
+            log_print("scene_add_node: out of memory\n");
+            return NULL;
+        }
+        scene->nodes = nodes;
+        scene->size = size;
+    }
+    pt_scene_node* node = &scene->nodes[scene->count];
+    memset(node, 0, sizeof(pt_scene_node));
+    node->ref = LUA_NOREF;
+    scene->count++;
+    return node;
+}
+
+// Capture every object in the list at list_idx, plus their children.
+// Returns the number of nodes added.
+static size_t scene_build_list(lua_State* L, pt_scene* scene, int list_idx)
+{
+    size_t start = scene->count;
+    size_t len = lua_rawlen(L, list_idx);
+    for (size_t i = 1; i <= len; i++) {
+        lua_rawgeti(L, list_idx, i);
+        if (!lua_istable(L, -1)) {
+            lua_pop(L, 1);
+            continue;
+        }
+        int obj = lua_gettop(L);
+        enum pt_scene_node_type type = scene_node_type(L, obj);
+        if (!type) {
+            lua_pop(L, 1);
+            continue;
+        }
+        size_t idx = scene->count;
+        pt_scene_node* node = scene_add_node(scene);
+        if (!node) {
+            lua_pop(L, 1);
+            break;
+        }
+        node->type = type;
+        node->size = 1;
+        lua_pushvalue(L, obj);
+        node->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+        if (scene_node_has_children(node)) {
+            lua_getfield(L, obj, "objects");
+            if (lua_istable(L, -1)) {
+                // node may move when the array is resized
+                const void* list = lua_topointer(L, -1);
+                size_t list_len = lua_rawlen(L, -1);
+                size_t children = scene_build_list(L, scene, lua_gettop(L));
+                scene->nodes[idx].list = list;
+                scene->nodes[idx].list_len = list_len;
+                scene->nodes[idx].size += children;
+            }
+            lua_pop(L, 1);
+        }
+        lua_pop(L, 1);
+    }
+    return scene->count - start;
+}
+
+// Check that the captured tree still matches the Lua lists.
+static bool scene_check(lua_State* L, pt_scene* scene, int list_idx, int64_t revision)
+{
+    if (!scene->valid || scene->revision != revision)
+        return false;
+    if (scene->list != lua_topointer(L, list_idx) || scene->list_len != lua_rawlen(L, list_idx))
+        return false;
+    for (size_t i = 0; i < scene->count; i++) {
+        pt_scene_node* node = &scene->nodes[i];
+        if (!scene_node_has_children(node))
+            continue;
+        lua_rawgeti(L, LUA_REGISTRYINDEX, node->ref);
+        lua_getfield(L, -1, "objects");
+        const void* list = lua_istable(L, -1) ? lua_topointer(L, -1) : NULL;
+        size_t list_len = list ? lua_rawlen(L, -1) : 0;
+        lua_pop(L, 2);
+        if (list != node->list || list_len != node->list_len)
+            return false;
+    }
+    return true;
+}
+
+static void scene_build(lua_State* L, pt_scene* scene, int list_idx, int64_t revision)
+{
+    scene_clear(L, scene);
+    lua_pushvalue(L, list_idx);
+    scene->list_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    scene->list = lua_topointer(L, list_idx);
+    scene->list_len = lua_rawlen(L, list_idx);
+    scene->revision = revision;
+    scene_build_list(L, scene, list_idx);
+    scene->valid = true;
+}
+
+// Push the animation frame of the sprite at idx, advancing it if required.
+// Mirrors PTGetImageFromObject.
+static uint8_t scene_push_sprite_frame(pt_scene_frame* frame, int idx)
+{
+    lua_State* L = frame->L;
+    uint8_t flags = (uint8_t)scene_get_integer(L, idx, "anim_flags", 0);
+    lua_getfield(L, idx, "animations");
+    if (!lua_istable(L, -1)) {
+        lua_pop(L, 1);
+        lua_pushnil(L);
+        return 0;
+    }
+    lua_getfield(L, idx, "anim_index");
+    lua_gettable(L, -2);
+    if (!lua_istable(L, -1)) {
+        lua_pop(L, 2);
+        lua_pushnil(L);
+        return 0;
+    }
+    int anim = lua_gettop(L);
+
+    lua_getfield(L, anim, "frames");
+    int frames = lua_gettop(L);
+    lua_Integer frame_count = lua_istable(L, frames) ? (lua_Integer)lua_rawlen(L, frames) : 0;
+    lua_Integer current_frame = scene_get_integer(L, anim, "current_frame", 0);
+    lua_getfield(L, anim, "rate");
+    int rate = lua_gettop(L);
+
+    bool set_wait = false;
+    if (lua_tonumber(L, rate) == 0) {
+        // Rate is 0, don't automatically change frames
+        if (current_frame == 0)
+            current_frame = 1;
+    } else if (current_frame == 0) {
+        current_frame = 1;
+        set_wait = true;
+    } else {
+        lua_getfield(L, anim, "next_wait");
+        if (!lua_isnumber(L, -1)) {
+            lua_pop(L, 1);
+            lua_pushinteger(L, 0);
+        }
+        lua_pushinteger(L, frame->millis);
+        if (lua_compare(L, -2, -1, LUA_OPLT)) {
+            if (!scene_get_bool(L, anim, "looping")) {
+                if (current_frame < frame_count)
+                    current_frame++;
+            } else if (frame_count > 0) {
+                current_frame = (current_frame % frame_count) + 1;
+            }
+            set_wait = true;
+        }
+        lua_pop(L, 2);
+    }
+    lua_pushinteger(L, current_frame);
+    lua_setfield(L, anim, "current_frame");
+    if (set_wait) {
+        // next_wait = millis + (1000 // rate)
+        lua_pushinteger(L, frame->millis);
+        lua_pushinteger(L, 1000);
+        lua_pushvalue(L, rate);
+        lua_arith(L, LUA_OPIDIV);
+        lua_arith(L, LUA_OPADD);
+        lua_setfield(L, anim, "next_wait");
+    }
+    lua_pop(L, 1);
+
+    if (lua_istable(L, frames)) {
+        lua_rawgeti(L, frames, current_frame);
+    } else {
+        lua_pushnil(L);
+    }
+    // Leave just the frame on the stack
+    lua_replace(L, anim - 1);
+    lua_settop(L, anim - 1);
+    return flags;
+}
+
+// Push the image for the object at idx. Mirrors PTGetImageFromObject.
+static uint8_t scene_push_image(pt_scene_frame* frame, int idx, enum pt_scene_node_type type)
+{
+    lua_State* L = frame->L;
+    switch (type) {
+    case SCENE_NODE_SPRITE:
+        return scene_push_sprite_frame(frame, idx);
+    case SCENE_NODE_ACTOR: {
+        uint8_t flags = 0;
+        lua_getfield(L, idx, "sprite");
+        if (lua_istable(L, -1) && scene_node_type(L, -1) == SCENE_NODE_SPRITE) {
+            flags = scene_push_sprite_frame(frame, lua_gettop(L));
+        } else {
+            lua_pushnil(L);
+        }
+        lua_remove(L, -2);
+        return flags;
+    }
+    case SCENE_NODE_BACKGROUND:
+    case SCENE_NODE_PANEL:
+        lua_getfield(L, idx, "image");
+        return 0;
+    case SCENE_NODE_BUTTON: {
+        const char* key = "default";
+        lua_getfield(L, idx, "images");
+        if (!lua_istable(L, -1)) {
+            lua_pop(L, 1);
+            break;
+        }
+        int images = lua_gettop(L);
+        lua_getfield(L, images, "disabled");
+        lua_getfield(L, images, "active");
+        lua_getfield(L, images, "hover");
+        if (scene_get_bool(L, idx, "disabled") && lua_toboolean(L, images + 1)) {
+            key = "disabled";
+        } else if (scene_get_bool(L, idx, "active") && lua_toboolean(L, images + 2)) {
+            key = "active";
+        } else if (scene_get_bool(L, idx, "hover") && lua_toboolean(L, images + 3)) {
+            key = "hover";
+        }
+        lua_settop(L, images);
+        lua_getfield(L, images, key);
+        lua_remove(L, images);
+        return 0;
+    }
+    default:
+        break;
+    }
+    lua_pushnil(L);
+    return 0;
+}
+
+// Blit the PTImage/PTTextLayout/PT9Slice at the top of the stack. Mirrors PTDrawImage.
+static void scene_blit(pt_scene_frame* frame, int16_t x, int16_t y, uint8_t flags)
+{
+    lua_State* L = frame->L;
+    pt_scene_key* key = frame->key;
+    int idx = lua_gettop(L);
+    if (!lua_istable(L, idx))
+        return;
+    lua_getfield(L, idx, "_type");
+    const char* type = lua_tostring(L, -1);
+    if (!type) {
+    } else if (strcmp(type, "PTImage") == 0) {
+        lua_getfield(L, idx, "ptr");
+        pt_image** imageptr = (pt_image**)lua_touserdata(L, -1);
+        if (imageptr && key) {
+            scene_key_push(key, *imageptr ? (int32_t)(*imageptr)->serial : 0);
+            scene_key_push(key, x);
+            scene_key_push(key, y);
+            scene_key_push(key, flags);
+        } else if (imageptr) {
+            image_blit(*imageptr, x, y, flags);
+        }
+        lua_pop(L, 1);
+    } else if (strcmp(type, "PTTextLayout") == 0) {
+        lua_getfield(L, idx, "ptr");
+        pt_text** textptr = (pt_text**)lua_touserdata(L, -1);
+        // nil or negative draws every glyph, same as _PTDrawText
+        lua_Integer reveal = scene_get_integer(L, idx, "reveal", -1);
+        size_t count = reveal >= 0 ? (size_t)reveal : SIZE_MAX;
+        if (textptr && key) {
+            // negative, so text serials never match an image serial
+            scene_key_push(key, *textptr ? -(int32_t)(*textptr)->serial : 0);
+            scene_key_push(key, x);
+            scene_key_push(key, y);
+            // past the last glyph looks the same as drawing them all
+            size_t shown = (*textptr && (count > (*textptr)->glyph_count)) ? (*textptr)->glyph_count : count;
+            scene_key_push(key, (int32_t)shown);
+        } else if (textptr && *textptr) {
+            text_draw(*textptr, x, y, count);
+        }
+        lua_pop(L, 1);
+    } else if (strcmp(type, "PT9Slice") == 0) {
+        lua_getfield(L, idx, "image");
+        if (lua_istable(L, -1)) {
+            lua_getfield(L, -1, "ptr");
+            pt_image** imageptr = (pt_image**)lua_touserdata(L, -1);
+            if (imageptr && key) {
+                scene_key_push(key, *imageptr ? (int32_t)(*imageptr)->serial : 0);
+                scene_key_push(key, x);
+                scene_key_push(key, y);
+                scene_key_push(key, flags);
+                scene_key_push(key, (int32_t)scene_get_integer(L, idx, "width", 0));
+                scene_key_push(key, (int32_t)scene_get_integer(L, idx, "height", 0));
+                scene_key_push(key, (int32_t)scene_get_integer(L, idx, "x1", 0));
+                scene_key_push(key, (int32_t)scene_get_integer(L, idx, "y1", 0));
+                scene_key_push(key, (int32_t)scene_get_integer(L, idx, "x2", 0));
+                scene_key_push(key, (int32_t)scene_get_integer(L, idx, "y2", 0));
+            } else if (imageptr) {
+                image_blit_9slice(*imageptr, x, y, flags, scene_get_integer(L, idx, "width", 0),
+                    scene_get_integer(L, idx, "height", 0), scene_get_integer(L, idx, "x1", 0),
+                    scene_get_integer(L, idx, "y1", 0), scene_get_integer(L, idx, "x2", 0),
+                    scene_get_integer(L, idx, "y2", 0));
+            }
+            lua_pop(L, 1);
+        }
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+}
+
+static void scene_draw_object(pt_scene_frame* frame, int idx, enum pt_scene_node_type type, lua_Number x, lua_Number y)
+{
+    lua_State* L = frame->L;
+    uint8_t flags = scene_push_image(frame, idx, type);
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        return;
+    }
+    if (frame->room) {
+        // Convert from room space to screen space, see PTRoomToScreen
+        lua_Number parallax_x = scene_get_number(L, idx, "parallax_x", 1);
+        lua_Number parallax_y = scene_get_number(L, idx, "parallax_y", 1);
+        x = floor((x - frame->room_x) * parallax_x) + frame->origin_x;
+        y = floor((y - frame->room_y) * parallax_y) + frame->origin_y;
+    }
+    scene_blit(frame, (int16_t)floor(x), (int16_t)floor(y), flags);
+    lua_pop(L, 1);
+}
+
+static size_t scene_draw_node(pt_scene_frame* frame, pt_scene* scene, size_t idx, lua_Number ox, lua_Number oy);
+
+static void scene_draw_children(
+    pt_scene_frame* frame, pt_scene* scene, size_t idx, int obj, lua_Number x, lua_Number y)
+{
+    lua_Number ox = x - scene_get_number(frame->L, obj, "origin_x", 0);
+    lua_Number oy = y - scene_get_number(frame->L, obj, "origin_y", 0);
+    size_t next = idx + scene->nodes[idx].size;
+    size_t i = idx + 1;
+    while (i < next) {
+        i = scene_draw_node(frame, scene, i, ox, oy);
+    }
+}
+
+// Draw the node at idx and its children, with an offset from the parent.
+// Mirrors the traversal order of PTIterObjects.
+// Returns the index of the next sibling.
+static size_t scene_draw_node(pt_scene_frame* frame, pt_scene* scene, size_t idx, lua_Number ox, lua_Number oy)
+{
+    lua_State* L = frame->L;
+    pt_scene_node node = scene->nodes[idx];
+    size_t next = idx + node.size;
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, node.ref);
+    int obj = lua_gettop(L);
+    if (!scene_get_bool(L, obj, "visible")) {
+        lua_pop(L, 1);
+        return next;
+    }
+    lua_Number x = ox + scene_get_number(L, obj, "x", 0) + scene_get_number(L, obj, "sx", 0);
+    lua_Number y = oy + scene_get_number(L, obj, "y", 0) + scene_get_number(L, obj, "sy", 0);
+
+    switch (node.type) {
+    case SCENE_NODE_GROUP:
+    case SCENE_NODE_SLIDER:
+        // Empty groups and sliders are skipped entirely
+        if (node.list_len > 0)
+            scene_draw_children(frame, scene, idx, obj, x, y);
+        break;
+    case SCENE_NODE_PANEL:
+    case SCENE_NODE_BUTTON:
+        scene_draw_object(frame, obj, node.type, x, y);
+        scene_draw_children(frame, scene, idx, obj, x, y);
+        break;
+    default:
+        scene_draw_object(frame, obj, node.type, x, y);
+        break;
+    }
+    lua_pop(L, 1);
+    return next;
+}
+
+// Draw the run of objects at the start of the list which are flagged as static.
+// These are composited once into a layer kept by the video driver, and the layer
+// is copied back each frame until one of the objects draws something different.
+// Returns the index of the first node that still needs drawing.
+static size_t scene_draw_static(pt_scene_frame* frame, pt_scene* scene)
+{
+    lua_State* L = frame->L;
+    size_t end = 0;
+    while (end < scene->count) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, scene->nodes[end].ref);
+        bool is_static = scene_get_bool(L, lua_gettop(L), "static");
+        lua_pop(L, 1);
+        if (!is_static)
+            break;
+        end += scene->nodes[end].size;
+    }
+    // The layer replaces the whole framebuffer, so it can only be used if
+    // the frame started from a clear screen.
+    if (!end || !pt_sys.video->save_layer || !pt_sys.video->restore_layer || !dirty_log_cleared())
+        return 0;
+
+    // Work out what the static objects would draw
+    pt_scene_key* key = &scene_key;
+    key->count = 0;
+    key->failed = false;
+    scene_key_push(key, pt_sys.palette_revision);
+    scene_key_push(key, pt_sys.palette_epoch);
+    scene_key_push(key, (int32_t)end);
+    frame->key = key;
+    size_t i = 0;
+    while (i < end) {
+        i = scene_draw_node(frame, scene, i, 0, 0);
+    }
+    frame->key = NULL;
+    if (key->failed)
+        return 0;
+
+    pt_scene_layer* layer = &scene_layer;
+    size_t before_count = 0;
+    const pt_dirty_op* before = dirty_log_get(&before_count);
+    if (layer->valid && (layer->key.count == key->count)
+        && !memcmp(layer->key.values, key->values, sizeof(int32_t) * key->count)
+        && (layer->before_count == before_count)
+        && !memcmp(layer->before, before, sizeof(pt_dirty_op) * before_count) && pt_sys.video->restore_layer()) {
+        // Log the ops the objects would have, so dirty tracking sees the same frame
+        dirty_log_replay(layer->ops, layer->op_count);
+        return end;
+    }
+
+    // Recompose the layer
+    layer->valid = false;
+    if (!scene_reserve((void**)&layer->before, &layer->before_size, before_count, sizeof(pt_dirty_op)))
+        return 0;
+    memcpy(layer->before, before, sizeof(pt_dirty_op) * before_count);
+    layer->before_count = before_count;
+    i = 0;
+    while (i < end) {
+        i = scene_draw_node(frame, scene, i, 0, 0);
+    }
+    size_t op_count = 0;
+    const pt_dirty_op* ops = dirty_log_get(&op_count);
+    op_count -= before_count;
+    if (!scene_reserve((void**)&layer->ops, &layer->op_size, op_count, sizeof(pt_dirty_op)))
+        return end;
+    memcpy(layer->ops, ops + before_count, sizeof(pt_dirty_op) * op_count);
+    layer->op_count = op_count;
+
+    pt_scene_key tmp = layer->key;
+    layer->key = *key;
+    *key = tmp;
+    layer->valid = pt_sys.video->save_layer();
+    return end;
+}
+
+void scene_render(lua_State* L, enum pt_scene_slot slot, int list_idx, int64_t revision, int room_idx)
+{
+    if (slot >= SCENE_MAX) {
+        log_print("scene_render: invalid slot %d\n", slot);
+        return;
+    }
+    list_idx = lua_absindex(L, list_idx);
+    if (!lua_istable(L, list_idx)) {
+        log_print("scene_render: expected a render list\n");
+        return;
+    }
+    pt_scene* scene = &scenes[slot];
+    if (!scene_check(L, scene, list_idx, revision))
+        scene_build(L, scene, list_idx, revision);
+
+    pt_scene_frame frame = { 0 };
+    frame.L = L;
+    frame.millis = pt_sys.timer->millis();
+    if (room_idx && lua_istable(L, room_idx)) {
+        frame.room = true;
+        frame.room_x = scene_get_number(L, room_idx, "x", 0) + scene_get_number(L, room_idx, "sx", 0);
+        frame.room_y = scene_get_number(L, room_idx, "y", 0) + scene_get_number(L, room_idx, "sy", 0);
+        frame.origin_x = scene_get_number(L, room_idx, "origin_x", 0);
+        frame.origin_y = scene_get_number(L, room_idx, "origin_y", 0);
+    }
+
+    int top = lua_gettop(L);
+    size_t i = 0;
+    if (slot == SCENE_ROOM)
+        i = scene_draw_static(&frame, scene);
+    while (i < scene->count) {
+        i = scene_draw_node(&frame, scene, i, 0, 0);
+    }
+    lua_settop(L, top);
+}
+
+void scene_shutdown()
+{
+    // The Lua state is gone, so the references are already dead
+    for (int i = 0; i < SCENE_MAX; i++) {
+        scene_clear(NULL, &scenes[i]);
+        if (scenes[i].nodes) {
+            free(scenes[i].nodes);
+            scenes[i].nodes = NULL;
+        }
+        scenes[i].size = 0;
+    }
+    free(scene_key.values);
+    free(scene_layer.key.values);
+    free(scene_layer.before);
+    free(scene_layer.ops);
+    memset(&scene_key, 0, sizeof(pt_scene_key));
+    memset(&scene_layer, 0, sizeof(pt_scene_layer));
+}
@@ -0,0 +1,61 @@
+#ifndef PERENTIE_SCENE_H
+#define PERENTIE_SCENE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Retained display list for the Lua render lists.
+// The tree of objects (groups, panels, sprites, etc.) is captured once,
+// and only rebuilt when the membership or ordering of a list changes.
+// Each frame the tree is walked and blitted from C; the per-object state
+// (position, visibility, animation) is still owned by the Lua tables and
+// is read from them directly.
+
+typedef struct lua_State lua_State;
+typedef struct pt_scene_node pt_scene_node;
+typedef struct pt_scene pt_scene;
+
+enum pt_scene_slot {
+    SCENE_ROOM = 0,
+    SCENE_GLOBAL = 1,
+    SCENE_PANELS = 2,
+    SCENE_MAX = 3,
+};
+
+enum pt_scene_node_type {
+    SCENE_NODE_BACKGROUND = 1,
+    SCENE_NODE_SPRITE = 2,
+    SCENE_NODE_ACTOR = 3,
+    SCENE_NODE_GROUP = 4,
+    SCENE_NODE_PANEL = 5,
+    SCENE_NODE_BUTTON = 6,
+    SCENE_NODE_SLIDER = 7,
+};
+
+struct pt_scene_node {
+    enum pt_scene_node_type type;
+    // Registry reference to the Lua object
+    int ref;
+    // Identity and length of the object's child list
+    const void* list;
+    size_t list_len;
+    // Number of nodes in this subtree, including this one
+    size_t size;
+};
+
+struct pt_scene {
+    pt_scene_node* nodes;
+    size_t count;
+    size_t size;
+    int list_ref;
+    const void* list;
+    size_t list_len;
+    int64_t revision;
+    bool valid;
+};
+
+void scene_render(lua_State* L, enum pt_scene_slot slot, int list_idx, int64_t revision, int room_idx);
+void scene_shutdown();
+
+#endif
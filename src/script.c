@@ -17,6 +17,7 @@
 #include "musicrad.h"
 #include "pcspeak.h"
 #include "repl.h"
+#include "scene.h"
 #include "script.h"
 #include "system.h"
 #include "text.h"
@@ -418,8 +419,19 @@ static int lua_pt_set_image_origin(lua_State* L)
         log_print("lua_pt_get_image_origin: invalid or missing image pointer\n");
         return 0;
     }
-    (*imageptr)->origin_x = (int16_t)luaL_checkinteger(L, 2);
-    (*imageptr)->origin_y = (int16_t)luaL_checkinteger(L, 3);
+    int16_t origin_x = (int16_t)luaL_checkinteger(L, 2);
+    int16_t origin_y = (int16_t)luaL_checkinteger(L, 3);
+    if ((*imageptr)->refs > 1) {
+        // Images can be shared (e.g. by the text cache); give this
+        // owner its own copy rather than moving everyone else's.
+        pt_image* copy = create_image_copy(*imageptr);
+        if (!copy)
+            return 0;
+        destroy_image(*imageptr);
+        *imageptr = copy;
+    }
+    (*imageptr)->origin_x = origin_x;
+    (*imageptr)->origin_y = origin_y;
     // log_print("lua_pt_set_image_origin: setting %p origin to %d, %d\n", (*imageptr), (*imageptr)->origin_x,
     //     (*imageptr)->origin_y);
     return 0;
@@ -473,9 +485,7 @@ static int lua_pt_text(lua_State* L)
     uint8_t brd_g = (uint8_t)luaL_checkinteger(L, 9);
     uint8_t brd_b = (uint8_t)luaL_checkinteger(L, 10);
 
-    pt_text* text = create_text(string, len, *fontptr, width, align);
-    pt_image* image = text_to_image(text, r, g, b, brd_r, brd_g, brd_b);
-    destroy_text(text);
+    pt_image* image = create_text_image(string, len, *fontptr, width, align, r, g, b, brd_r, brd_g, brd_b);
     if (!image) {
         lua_pushnil(L);
         return 1;
@@ -493,6 +503,82 @@ static int lua_pt_text(lua_State* L)
     return 1;
 }
 
+static int lua_pt_text_layout_gc(lua_State* L)
+{
+    pt_text** target = (pt_text**)lua_touserdata(L, 1);
+    if (target && *target) {
+        destroy_text(*target);
+        *target = NULL;
+    }
+    return 0;
+}
+
+static int lua_pt_text_layout(lua_State* L)
+{
+    size_t len = 0;
+    const byte* string = (const byte*)luaL_checklstring(L, 1, &len);
+    pt_font** fontptr = (pt_font**)lua_touserdata(L, 2);
+    if (!fontptr || !*fontptr) {
+        log_print("lua_pt_text_layout: invalid or missing font\n");
+        lua_pushnil(L);
+        return 1;
+    }
+    uint16_t width = luaL_checkinteger(L, 3);
+    enum pt_text_align align = (enum pt_text_align)luaL_checkinteger(L, 4);
+    uint8_t colours[6];
+    for (int i = 0; i < 6; i++)
+        colours[i] = (uint8_t)luaL_checkinteger(L, 5 + i);
+
+    // Set up the userdata first, so the layout can't leak if Lua raises an error
+    pt_text** target = lua_newuserdatauv(L, sizeof(pt_text*), 1);
+    *target = NULL;
+    lua_newtable(L);
+    lua_pushstring(L, "PTTextLayout");
+    lua_setfield(L, -2, "__name");
+    lua_pushcfunction(L, lua_pt_text_layout_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_setmetatable(L, -2);
+
+    pt_text* text = create_text(string, len, *fontptr, width, align);
+    if (!text) {
+        lua_pop(L, 1);
+        lua_pushnil(L);
+        return 1;
+    }
+    memcpy(text->colours, colours, sizeof(colours));
+    *target = text;
+    // the layout points at the font, so keep it alive
+    lua_pushvalue(L, 2);
+    lua_setiuservalue(L, -2, 1);
+    lua_pushinteger(L, text->width);
+    lua_pushinteger(L, text->height);
+    lua_pushinteger(L, text->glyph_count);
+    return 4;
+}
+
+static int lua_pt_draw_text(lua_State* L)
+{
+    pt_text** textptr = (pt_text**)lua_touserdata(L, 1);
+    if (!textptr || !*textptr) {
+        log_print("lua_pt_draw_text: invalid or missing text layout\n");
+        return 0;
+    }
+    int16_t x = luaL_checkinteger(L, 2);
+    int16_t y = luaL_checkinteger(L, 3);
+    // Same rule as the scene renderer: nil or negative draws every glyph
+    lua_Integer reveal = lua_isnumber(L, 4) ? lua_tointeger(L, 4) : -1;
+    size_t count = reveal >= 0 ? (size_t)reveal : SIZE_MAX;
+    text_draw(*textptr, x, y, count);
+    return 0;
+}
+
+static int lua_pt_set_text_cache_budget(lua_State* L)
+{
+    lua_Integer budget = luaL_checkinteger(L, 1);
+    text_cache_set_budget(budget > 0 ? (size_t)budget : 0);
+    return 0;
+}
+
 static int lua_pt_clear_screen(lua_State* L)
 {
     pt_sys.video->clear();
@@ -515,6 +601,30 @@ static int lua_pt_draw_image(lua_State* L)
     return 0;
 }
 
+static int lua_pt_draw_images(lua_State* L)
+{
+    // Takes a flat list of entries: { image, x, y, flags, image, x, y, flags, ... }
+    luaL_checktype(L, 1, LUA_TTABLE);
+    size_t len = lua_rawlen(L, 1);
+    for (size_t i = 1; i + 3 <= len; i += 4) {
+        lua_rawgeti(L, 1, i);
+        lua_rawgeti(L, 1, i + 1);
+        lua_rawgeti(L, 1, i + 2);
+        lua_rawgeti(L, 1, i + 3);
+        pt_image** imageptr = (pt_image**)lua_touserdata(L, -4);
+        if (!imageptr) {
+            log_print("lua_pt_draw_images: invalid or missing image pointer at index %d\n", (int)i);
+        } else {
+            int16_t x = lua_tointeger(L, -3);
+            int16_t y = lua_tointeger(L, -2);
+            uint8_t flags = lua_tointeger(L, -1);
+            image_blit(*imageptr, x, y, flags);
+        }
+        lua_pop(L, 4);
+    }
+    return 0;
+}
+
 static int lua_pt_draw_9slice(lua_State* L)
 {
     // pt_image **imageptr = (pt_image **)luaL_checkudata(L, 1, "PTImage");
@@ -537,6 +647,15 @@ static int lua_pt_draw_9slice(lua_State* L)
     return 0;
 }
 
+static int lua_pt_scene_render(lua_State* L)
+{
+    enum pt_scene_slot slot = luaL_checkinteger(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    int64_t revision = luaL_checkinteger(L, 3);
+    scene_render(L, slot, 2, revision, lua_istable(L, 4) ? 4 : 0);
+    return 0;
+}
+
 static int lua_pt_draw_line(lua_State* L)
 {
     int16_t x0 = luaL_checkinteger(L, 1);
@@ -757,6 +876,69 @@ static int lua_pt_set_overscan_colour(lua_State* L)
     return 0;
 };
 
+static int lua_pt_add_palette_cycle(lua_State* L)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);
+    uint32_t delay = luaL_checkinteger(L, 2);
+    bool reverse = lua_toboolean(L, 3);
+    uint8_t slots[PALETTE_CYCLE_LENGTH];
+    int count = luaL_len(L, 1);
+    if (count > PALETTE_CYCLE_LENGTH)
+        count = PALETTE_CYCLE_LENGTH;
+    for (int i = 0; i < count; i++) {
+        lua_geti(L, 1, i + 1);
+        luaL_checktype(L, -1, LUA_TTABLE);
+        lua_geti(L, -1, 1);
+        uint8_t r = luaL_checkinteger(L, -1);
+        lua_geti(L, -2, 2);
+        uint8_t g = luaL_checkinteger(L, -1);
+        lua_geti(L, -3, 3);
+        uint8_t b = luaL_checkinteger(L, -1);
+        lua_pop(L, 4);
+        slots[i] = map_colour(r, g, b);
+    }
+    uint32_t id = palette_cycle_add(slots, count, delay, reverse);
+    if (id)
+        lua_pushinteger(L, id);
+    else
+        lua_pushnil(L);
+    return 1;
+};
+
+static int lua_pt_remove_palette_cycle(lua_State* L)
+{
+    uint32_t id = luaL_checkinteger(L, 1);
+    lua_pushboolean(L, palette_cycle_remove(id));
+    return 1;
+};
+
+static int lua_pt_fade_palette(lua_State* L)
+{
+    pt_colour_rgb colour = { 0x00, 0x00, 0x00 };
+    bool has_colour = lua_istable(L, 1);
+    if (has_colour) {
+        lua_geti(L, 1, 1);
+        colour.r = luaL_checkinteger(L, -1);
+        lua_pop(L, 1);
+        lua_geti(L, 1, 2);
+        colour.g = luaL_checkinteger(L, -1);
+        lua_pop(L, 1);
+        lua_geti(L, 1, 3);
+        colour.b = luaL_checkinteger(L, -1);
+        lua_pop(L, 1);
+    }
+    float amount = luaL_checknumber(L, 2);
+    uint32_t duration = luaL_optinteger(L, 3, 0);
+    palette_fade(has_colour ? &colour : NULL, amount, duration);
+    return 0;
+};
+
+static int lua_pt_is_palette_fading(lua_State* L)
+{
+    lua_pushboolean(L, palette_is_fading());
+    return 1;
+};
+
 static int lua_pt_set_dither_hint(lua_State* L)
 {
     luaL_checktype(L, 1, LUA_TTABLE);
@@ -959,9 +1141,14 @@ static const struct luaL_Reg lua_funcs[] = {
     { "_PTSetImageOrigin", lua_pt_set_image_origin },
     { "_PTFont", lua_pt_font },
     { "_PTText", lua_pt_text },
+    { "_PTSetTextCacheBudget", lua_pt_set_text_cache_budget },
+    { "_PTTextLayout", lua_pt_text_layout },
+    { "_PTDrawText", lua_pt_draw_text },
     { "_PTClearScreen", lua_pt_clear_screen },
     { "_PTDrawImage", lua_pt_draw_image },
+    { "_PTDrawImages", lua_pt_draw_images },
     { "_PTDraw9Slice", lua_pt_draw_9slice },
+    { "_PTSceneRender", lua_pt_scene_render },
     { "_PTDrawLine", lua_pt_draw_line },
     { "_PTImageTestCollision", lua_pt_image_test_collision },
     { "_PT9SliceTestCollision", lua_pt_9slice_test_collision },
@@ -972,6 +1159,10 @@ static const struct luaL_Reg lua_funcs[] = {
     { "_PTGetPalette", lua_pt_get_palette },
     { "_PTSetPaletteRemapper", lua_pt_set_palette_remapper },
     { "_PTSetOverscanColour", lua_pt_set_overscan_colour },
+    { "_PTAddPaletteCycle", lua_pt_add_palette_cycle },
+    { "_PTRemovePaletteCycle", lua_pt_remove_palette_cycle },
+    { "_PTFadePalette", lua_pt_fade_palette },
+    { "_PTIsPaletteFading", lua_pt_is_palette_fading },
     { "_PTSetDitherHint", lua_pt_set_dither_hint },
     { "_PTSetDebugConsole", lua_pt_set_debug_console },
     { "_PTSetGameInfo", lua_pt_set_game_info },
@@ -1113,6 +1304,8 @@ void script_reset()
     log_print("script_reset(): Resetting Perentie state!\n");
     lua_close(main_thread);
     main_thread = NULL;
+    scene_shutdown();
+    text_cache_clear();
     // clear palette + remove dithering rules
     palette_init();
 
@@ -1139,6 +1332,8 @@ void script_shutdown()
     if (main_thread) {
         lua_close(main_thread);
         main_thread = NULL;
+        scene_shutdown();
+        text_cache_clear();
         // just in case the game tries to go on
         has_quit = true;
     }
@@ -15,16 +15,21 @@
 #include <emscripten.h>
 #endif
 
+#include "dirty.h"
 #include "event.h"
 #include "fs.h"
 #include "image.h"
+#include "linear.h"
 #include "log.h"
+#include "modex.h"
 #include "pcspeak.h"
+#include "planar.h"
 #include "rect.h"
 #include "script.h"
 #include "sdl.h"
 #include "system.h"
 #include "utils.h"
+#include "vgaemu.h"
 #include "woodypc/pcspeak.h"
 
 static SDL_AudioDeviceID audio_out = 0;
@@ -33,6 +38,263 @@ static SDL_Renderer* renderer = NULL;
 
 static SDL_Texture* framebuffer = NULL;
 
+// Drawing is deferred until the end of the frame, so that it can be
+// replayed into only the parts of the framebuffer which have changed.
+enum sdl_draw_op_type {
+    SDL_DRAW_CLEAR = 1,
+    SDL_DRAW_TEXTURE = 2,
+    SDL_DRAW_LINE = 3,
+};
+
+typedef struct sdl_draw_op sdl_draw_op;
+struct sdl_draw_op {
+    enum sdl_draw_op_type type;
+    SDL_Texture* texture;
+    SDL_FRect dstrect;
+    // Texture coordinates, swapped around for flipped images
+    float u0, v0, u1, v1;
+    // Palette slot to fill or draw the line with
+    uint8_t colour;
+    float x0, y0, x1, y1;
+};
+
+static sdl_draw_op* draw_ops = NULL;
+static size_t draw_ops_count = 0;
+static size_t draw_ops_size = 0;
+
+// Textures freed mid-frame may still be referenced by the draw queue.
+static SDL_Texture** graveyard = NULL;
+static size_t graveyard_count = 0;
+static size_t graveyard_size = 0;
+
+// Vertex batch for consecutive draws that share a texture.
+static SDL_Vertex* batch_verts = NULL;
+static int* batch_indices = NULL;
+static size_t batch_count = 0;
+static size_t batch_size = 0;
+static SDL_Texture* batch_texture = NULL;
+
+// Converted images are packed into a small number of shared atlas pages,
+// so that most of a frame can be drawn with a handful of geometry calls.
+// Each page is filled with shelves (rows of images with similar heights);
+// space is only reclaimed once every image on a page has been freed.
+#define ATLAS_PAGE_SIZE 1024
+#define ATLAS_MAX_PAGES 8
+#define ATLAS_MAX_SHELVES 128
+// Images bigger than this get a texture of their own
+#define ATLAS_MAX_IMAGE 512
+
+typedef struct sdl_atlas_shelf sdl_atlas_shelf;
+struct sdl_atlas_shelf {
+    int16_t y;
+    int16_t height;
+    int16_t x;
+};
+
+typedef struct sdl_atlas_page sdl_atlas_page;
+struct sdl_atlas_page {
+    SDL_Texture* texture;
+    sdl_atlas_shelf shelves[ATLAS_MAX_SHELVES];
+    int shelf_count;
+    int16_t top;
+    // Number of images currently stored in the page
+    int live;
+    // Palette slots used by the images stored in the page
+    pt_palette_deps deps;
+    // Bumped every time the page is emptied, so stale images can tell
+    uint32_t generation;
+};
+
+static sdl_atlas_page atlas[ATLAS_MAX_PAGES] = { 0 };
+static int atlas_count = 0;
+
+// With SDL 3.4 or later, images are kept as palette indices in palettized
+// textures which share one SDL_Palette; changing the palette only updates
+// that. Otherwise images are converted to 32-bit textures which hold the
+// palette index in the blue channel. The frame is drawn in indices, then
+// read back and looked up against the palette at the end, the same as the
+// software renderer; changing the palette only redoes the lookup.
+#if SDL_VERSION_ATLEAST(3, 4, 0)
+#define SDL_INDEXED_TEXTURES 1
+#define SDL_IMAGE_FORMAT SDL_PIXELFORMAT_INDEX8
+typedef uint8_t sdl_texel;
+// map_colour never hands out the last slot, so it's used for transparency
+#define SDL_TRANSPARENT_INDEX 0xff
+#else
+#define SDL_IMAGE_FORMAT SDL_PIXELFORMAT_ARGB8888
+typedef uint32_t sdl_texel;
+
+// Palette indices read back from the framebuffer, and their colours
+static byte* lookup_indices = NULL;
+static uint32_t* lookup_pixels = NULL;
+static SDL_Texture* lookup_texture = NULL;
+// Set when a palette slot on screen changes colour
+static bool lookup_all = false;
+#endif
+
+static SDL_Palette* image_palette = NULL;
+// Palette slots past this haven't been handed out to any images yet
+static int colour_top = 0;
+
+static SDL_Texture* sdlvideo_create_image_texture(int16_t width, int16_t height)
+{
+    SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_IMAGE_FORMAT, SDL_TEXTUREACCESS_STATIC, width, height);
+    if (!texture)
+        return NULL;
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+    SDL_SetTextureScaleMode(texture, SDL_SCALEMODE_NEAREST);
+#ifdef SDL_INDEXED_TEXTURES
+    SDL_SetTexturePalette(texture, image_palette);
+#endif
+    return texture;
+}
+
+// Colour to draw a palette slot with
+static SDL_Color sdlvideo_slot_colour(uint8_t idx)
+{
+#ifdef SDL_INDEXED_TEXTURES
+    pt_colour_rgb* c = &pt_sys.palette_display[idx];
+    return (SDL_Color) { c->r, c->g, c->b, SDL_ALPHA_OPAQUE };
+#else
+    // Same as the image texels; the colour gets looked up at the end
+    return (SDL_Color) { 0, 0, idx, SDL_ALPHA_OPAQUE };
+#endif
+}
+
+static sdl_draw_op* sdlvideo_push_op(enum sdl_draw_op_type type)
+{
+    if (draw_ops_count == draw_ops_size) {
+        size_t size = draw_ops_size ? draw_ops_size * 2 : 64;
+        sdl_draw_op* ops = (sdl_draw_op*)realloc(draw_ops, sizeof(sdl_draw_op) * size);
+        if (!ops) {
+            log_print("sdlvideo_push_op: out of memory\n");
+            return NULL;
+        }
+        draw_ops = ops;
+        draw_ops_size = size;
+    }
+    sdl_draw_op* op = &draw_ops[draw_ops_count];
+    memset(op, 0, sizeof(sdl_draw_op));
+    op->type = type;
+    draw_ops_count++;
+    return op;
+}
+
+static void sdlvideo_bury_texture(SDL_Texture* texture)
+{
+    if (!draw_ops_count) {
+        SDL_DestroyTexture(texture);
+        return;
+    }
+    if (graveyard_count == graveyard_size) {
+        size_t size = graveyard_size ? graveyard_size * 2 : 16;
+        SDL_Texture** textures = (SDL_Texture**)realloc(graveyard, sizeof(SDL_Texture*) * size);
+        if (!textures) {
+            // Can't defer it, so drop the queued draws that reference it
+            for (size_t i = 0; i < draw_ops_count; i++) {
+                if (draw_ops[i].texture == texture)
+                    draw_ops[i].type = 0;
+            }
+            dirty_mark_all();
+            SDL_DestroyTexture(texture);
+            return;
+        }
+        graveyard = textures;
+        graveyard_size = size;
+    }
+    graveyard[graveyard_count] = texture;
+    graveyard_count++;
+}
+
+static void sdlvideo_empty_graveyard()
+{
+    for (size_t i = 0; i < graveyard_count; i++) {
+        SDL_DestroyTexture(graveyard[i]);
+    }
+    graveyard_count = 0;
+}
+
+static bool sdlvideo_atlas_fit(sdl_atlas_page* page, int16_t width, int16_t height, int16_t* x, int16_t* y)
+{
+    // Use the first existing shelf that isn't too much taller than the image
+    for (int i = 0; i < page->shelf_count; i++) {
+        sdl_atlas_shelf* shelf = &page->shelves[i];
+        if ((shelf->height >= height) && (shelf->height <= height + height / 2 + 8)
+            && (shelf->x + width <= ATLAS_PAGE_SIZE)) {
+            *x = shelf->x;
+            *y = shelf->y;
+            shelf->x += width;
+            return true;
+        }
+    }
+    // Otherwise open a new one, rounding the height up to encourage reuse
+    int16_t shelf_height = (height + 7) & ~7;
+    if ((page->shelf_count == ATLAS_MAX_SHELVES) || (page->top + shelf_height > ATLAS_PAGE_SIZE))
+        return false;
+    sdl_atlas_shelf* shelf = &page->shelves[page->shelf_count];
+    shelf->y = page->top;
+    shelf->height = shelf_height;
+    shelf->x = width;
+    page->shelf_count++;
+    page->top += shelf_height;
+    *x = 0;
+    *y = shelf->y;
+    return true;
+}
+
+static int sdlvideo_atlas_alloc(int16_t width, int16_t height, int16_t* x, int16_t* y)
+{
+    for (int i = 0; i < atlas_count; i++) {
+        sdl_atlas_page* page = &atlas[i];
+        if (page->shelf_count == 0)
+            palette_deps_init(&page->deps);
+        // Stale pages get emptied once the draw queue has been replayed
+        if (!palette_deps_current(&page->deps))
+            continue;
+        if (sdlvideo_atlas_fit(page, width, height, x, y))
+            return i;
+    }
+    if (atlas_count == ATLAS_MAX_PAGES)
+        return -1;
+
+    sdl_atlas_page* page = &atlas[atlas_count];
+    page->texture = sdlvideo_create_image_texture(ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE);
+    if (!page->texture) {
+        log_print("sdlvideo_atlas_alloc: failed to create atlas page: %s\n", SDL_GetError());
+        return -1;
+    }
+    palette_deps_init(&page->deps);
+    atlas_count++;
+    if (!sdlvideo_atlas_fit(page, width, height, x, y))
+        return -1;
+    return atlas_count - 1;
+}
+
+static void sdlvideo_atlas_reclaim()
+{
+    // Only called once the draw queue is empty, as queued draws may still
+    // reference the space that's being handed back.
+    for (int i = 0; i < atlas_count; i++) {
+        sdl_atlas_page* page = &atlas[i];
+        if (page->shelf_count && (page->live == 0 || !palette_deps_current(&page->deps))) {
+            page->shelf_count = 0;
+            page->top = 0;
+            page->live = 0;
+            page->generation++;
+        }
+    }
+}
+
+static void sdlvideo_atlas_shutdown()
+{
+    for (int i = 0; i < atlas_count; i++) {
+        if (atlas[i].texture)
+            SDL_DestroyTexture(atlas[i].texture);
+    }
+    memset(atlas, 0, sizeof(atlas));
+    atlas_count = 0;
+}
+
 void sdl_init()
 {
     if (!SDL_InitSubSystem(SDL_INIT_VIDEO | SDL_INIT_AUDIO)) {
@@ -72,10 +334,10 @@ pt_drv_app sdl_app = { &sdl_init, &sdl_set_meta, &sdl_get_data_path, &sdl_shutdo
 
 void sdlvideo_shutdown();
 
-void sdlvideo_init()
+static bool sdlvideo_create_window()
 {
     if (window)
-        return;
+        return true;
 
     const char* name = SDL_GetAppMetadataProperty(SDL_PROP_APP_METADATA_NAME_STRING);
     if (strcmp(name, "SDL Application") == 0)
@@ -91,7 +353,7 @@ void sdlvideo_init()
     if (!window) {
         log_print("sdlvideo_init: Failed to create window: %s\n", SDL_GetError());
         SDL_QuitSubSystem(SDL_INIT_VIDEO);
-        return;
+        return false;
     }
     renderer = SDL_CreateRenderer(window, NULL);
     if (!renderer) {
@@ -99,101 +361,206 @@ void sdlvideo_init()
         SDL_DestroyWindow(window);
         window = NULL;
         SDL_QuitSubSystem(SDL_INIT_VIDEO);
-        return;
+        return false;
     }
     // SDL_SetRenderLogicalPresentation(renderer, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_LOGICAL_PRESENTATION_INTEGER_SCALE);
     SDL_SetRenderLogicalPresentation(renderer, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_LOGICAL_PRESENTATION_LETTERBOX);
-    framebuffer = SDL_CreateTexture(
-        renderer, SDL_GetWindowPixelFormat(window), SDL_TEXTUREACCESS_TARGET, SCREEN_WIDTH, SCREEN_HEIGHT);
-    // SDL_SetTextureScaleMode(framebuffer, SDL_SCALEMODE_LINEAR);
-    SDL_SetTextureScaleMode(framebuffer, SDL_SCALEMODE_NEAREST);
-    SDL_SetRenderTarget(renderer, framebuffer);
     SDL_SetRenderVSync(renderer, 1);
     SDL_HideCursor();
 #ifdef __EMSCRIPTEN__
     emscripten_hide_mouse();
 #endif
-    atexit(sdlvideo_shutdown);
+    return true;
 }
 
-void sdlvideo_shutdown()
+static void sdlvideo_destroy_window()
 {
-    if (!window)
-        return;
-
     char* crash = script_crash_message();
     if (crash) {
         SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "", crash, window);
     }
-    framebuffer = NULL;
     SDL_DestroyRenderer(renderer);
     renderer = NULL;
     SDL_DestroyWindow(window);
     window = NULL;
 }
 
+void sdlvideo_init()
+{
+    if (window)
+        return;
+
+    if (!sdlvideo_create_window())
+        return;
+#ifdef SDL_INDEXED_TEXTURES
+    SDL_PixelFormat format = SDL_GetWindowPixelFormat(window);
+#else
+    // Gets read back as palette indices, so needs exactly 8 bits per channel
+    SDL_PixelFormat format = SDL_PIXELFORMAT_XRGB8888;
+#endif
+    framebuffer = SDL_CreateTexture(renderer, format, SDL_TEXTUREACCESS_TARGET, SCREEN_WIDTH, SCREEN_HEIGHT);
+    // SDL_SetTextureScaleMode(framebuffer, SDL_SCALEMODE_LINEAR);
+    SDL_SetTextureScaleMode(framebuffer, SDL_SCALEMODE_NEAREST);
+    SDL_SetRenderTarget(renderer, framebuffer);
+    colour_top = pt_sys.palette_top;
+#ifdef SDL_INDEXED_TEXTURES
+    image_palette = SDL_CreatePalette(256);
+    if (image_palette) {
+        SDL_Color colours[256];
+        for (int i = 0; i < 256; i++) {
+            colours[i].r = pt_sys.palette_display[i].r;
+            colours[i].g = pt_sys.palette_display[i].g;
+            colours[i].b = pt_sys.palette_display[i].b;
+            colours[i].a = (i == SDL_TRANSPARENT_INDEX) ? SDL_ALPHA_TRANSPARENT : SDL_ALPHA_OPAQUE;
+        }
+        SDL_SetPaletteColors(image_palette, colours, 0, 256);
+    }
+#else
+    lookup_texture = SDL_CreateTexture(
+        renderer, SDL_PIXELFORMAT_XRGB8888, SDL_TEXTUREACCESS_STREAMING, SCREEN_WIDTH, SCREEN_HEIGHT);
+    if (!lookup_texture) {
+        log_print("sdlvideo_init: Failed to create texture: %s\n", SDL_GetError());
+    } else {
+        SDL_SetTextureScaleMode(lookup_texture, SDL_SCALEMODE_NEAREST);
+    }
+    lookup_indices = (byte*)calloc(SCREEN_WIDTH * SCREEN_HEIGHT, sizeof(byte));
+    lookup_pixels = (uint32_t*)calloc(SCREEN_WIDTH * SCREEN_HEIGHT, sizeof(uint32_t));
+    lookup_all = true;
+#endif
+    dirty_init(SCREEN_WIDTH, SCREEN_HEIGHT);
+    atexit(sdlvideo_shutdown);
+}
+
+void sdlvideo_shutdown()
+{
+    if (!window)
+        return;
+
+    draw_ops_count = 0;
+    sdlvideo_empty_graveyard();
+    if (draw_ops) {
+        free(draw_ops);
+        draw_ops = NULL;
+        draw_ops_size = 0;
+    }
+    if (graveyard) {
+        free(graveyard);
+        graveyard = NULL;
+        graveyard_size = 0;
+    }
+    if (batch_verts) {
+        free(batch_verts);
+        batch_verts = NULL;
+    }
+    if (batch_indices) {
+        free(batch_indices);
+        batch_indices = NULL;
+    }
+    batch_size = 0;
+    sdlvideo_atlas_shutdown();
+    if (image_palette) {
+        SDL_DestroyPalette(image_palette);
+        image_palette = NULL;
+    }
+#ifndef SDL_INDEXED_TEXTURES
+    if (lookup_texture) {
+        SDL_DestroyTexture(lookup_texture);
+        lookup_texture = NULL;
+    }
+    if (lookup_indices) {
+        free(lookup_indices);
+        lookup_indices = NULL;
+    }
+    if (lookup_pixels) {
+        free(lookup_pixels);
+        lookup_pixels = NULL;
+    }
+#endif
+    dirty_shutdown();
+    framebuffer = NULL;
+    sdlvideo_destroy_window();
+}
+
 void sdlvideo_clear()
 {
     if (!renderer)
         return;
 
-    pt_colour_rgb* fill = &pt_sys.palette[pt_sys.overscan];
-    SDL_SetRenderDrawColor(renderer, fill->r, fill->g, fill->b, SDL_ALPHA_OPAQUE);
-    SDL_RenderClear(renderer);
+    sdl_draw_op* op = sdlvideo_push_op(SDL_DRAW_CLEAR);
+    if (op)
+        op->colour = pt_sys.overscan;
+    dirty_log_clear(pt_sys.overscan);
 }
 
 pt_image_sdl* sdlvideo_convert_image(pt_image* image)
 {
     pt_image_sdl* result = (pt_image_sdl*)calloc(1, sizeof(pt_image_sdl));
-    SDL_Surface* draw = SDL_CreateSurface(image->width, image->height, SDL_PIXELFORMAT_INDEX8);
+    if (!result)
+        return NULL;
 
     // Create a mapping between image colours and global palette
-    byte palette_map[256];
-    for (int i = 0; i < 256; i++) {
-        uint8_t src = (image->palette_alpha[i] == 0)
-            ? 0xff
-            : map_colour(image->palette[3 * i], image->palette[3 * i + 1], image->palette[3 * i + 2]);
-        palette_map[i] = src;
-    }
-
-    // Create an image palette based on the global palette.
-    SDL_Palette* pal = SDL_CreatePalette(256);
-    for (int i = 0; i < 255; i++) {
-        pal->colors[i].r = pt_sys.palette[i].r;
-        pal->colors[i].g = pt_sys.palette[i].g;
-        pal->colors[i].b = pt_sys.palette[i].b;
-        pal->colors[i].a = 0xff;
-    }
-    // The 256th colour is used to indicate transparency, as that's how SDL rolls.
-    // This may be an issue if we completely deplete the palette space.
-    pal->colors[255].r = 0x00;
-    pal->colors[255].g = 0x00;
-    pal->colors[255].b = 0x00;
-    pal->colors[255].a = 0x00;
-
-    SDL_SetSurfacePalette(draw, pal);
-    result->revision = pt_sys.palette_revision;
-    for (int y = 0; y < draw->h; y++) {
-        for (int x = 0; x < draw->w; x++) {
+    const byte* palette_map = image_palette_get_map(image->palette);
+    pt_dither_map* dither_map = image_palette_get_dither_map(image->palette);
+    palette_deps_init(&result->deps);
+
+    // Convert to texels, with a transparent 1px border
+    // to keep neighbours in the atlas from bleeding in.
+    int16_t width = image->width + 2;
+    int16_t height = image->height + 2;
+    sdl_texel* pixels = (sdl_texel*)calloc(width * height, sizeof(sdl_texel));
+    if (!pixels) {
+        free(result);
+        return NULL;
+    }
+#ifdef SDL_INDEXED_TEXTURES
+    memset(pixels, SDL_TRANSPARENT_INDEX, width * height);
+#endif
+    for (int y = 0; y < image->height; y++) {
+        sdl_texel* dest = pixels + (y + 1) * width + 1;
+        for (int x = 0; x < image->width; x++) {
             byte pixel = image->data[y * image->pitch + x];
-            if (palette_map[pixel] == 0xff || (pixel == image->colourkey)) {
-                ((uint8_t*)draw->pixels)[y * draw->pitch + x] = 0xff;
-            } else {
-                ((uint8_t*)draw->pixels)[y * draw->pitch + x] = dither_calc(palette_map[pixel], x, y);
-            }
+            if ((image->palette->alpha[pixel] == 0) || (pixel == image->colourkey))
+                continue;
+            palette_deps_add(&result->deps, palette_map[pixel]);
+#ifdef SDL_INDEXED_TEXTURES
+            dest[x] = dither_map->phase[dither_phase(x, y)][pixel];
+#else
+            dest[x] = 0xff000000 | dither_map->phase[dither_phase(x, y)][pixel];
+#endif
         }
     }
 
-    result->texture = SDL_CreateTextureFromSurface(renderer, draw);
-    if (result->texture) {
-        SDL_SetTextureBlendMode(result->texture, SDL_BLENDMODE_BLEND);
-        SDL_SetTextureScaleMode(result->texture, SDL_SCALEMODE_NEAREST);
+    int16_t x = 0;
+    int16_t y = 0;
+    result->page = -1;
+    if ((width <= ATLAS_MAX_IMAGE) && (height <= ATLAS_MAX_IMAGE))
+        result->page = sdlvideo_atlas_alloc(width, height, &x, &y);
+
+    if (result->page >= 0) {
+        sdl_atlas_page* page = &atlas[result->page];
+        page->live++;
+        palette_deps_merge(&page->deps, &result->deps);
+        result->texture = page->texture;
+        result->generation = page->generation;
     } else {
-        log_print("sdlvideo_convert_image: failed to create %dx%d texture for %s: %s\n", draw->w, draw->h, image->path,
-            SDL_GetError());
+        result->texture = sdlvideo_create_image_texture(width, height);
+        if (!result->texture) {
+            log_print("sdlvideo_convert_image: failed to create %dx%d texture for %s: %s\n", width, height,
+                image->path, SDL_GetError());
+            free(pixels);
+            return result;
+        }
+    }
+
+    SDL_Rect area = { x, y, width, height };
+    if (!SDL_UpdateTexture(result->texture, &area, pixels, width * sizeof(sdl_texel))) {
+        log_print("sdlvideo_convert_image: failed to upload %s: %s\n", image->path, SDL_GetError());
     }
-    SDL_DestroySurface(draw);
-    SDL_DestroyPalette(pal);
+    free(pixels);
+    result->x = x + 1;
+    result->y = y + 1;
+    result->width = image->width;
+    result->height = image->height;
 
     return result;
 }
@@ -204,20 +571,35 @@ void sdlvideo_destroy_hw_image(void* hw_image)
     if (!image)
         return;
 
-    if (image->texture) {
-        SDL_DestroyTexture(image->texture);
+    if (image->page >= 0) {
+        // The space is handed back once the whole page is free
+        sdl_atlas_page* page = &atlas[image->page];
+        if ((page->generation == image->generation) && (page->live > 0))
+            page->live--;
+        image->texture = NULL;
+    } else if (image->texture) {
+        sdlvideo_bury_texture(image->texture);
         image->texture = NULL;
     }
 
     free(image);
 }
+
+static bool sdlvideo_image_is_current(pt_image_sdl* image)
+{
+    // The atlas page may have been emptied because of another image in it
+    if ((image->page >= 0) && (atlas[image->page].generation != image->generation))
+        return false;
+    return palette_deps_current(&image->deps);
+}
+
 void sdlvideo_blit_image(
     pt_image* image, int16_t x, int16_t y, uint8_t flags, int16_t left, int16_t top, int16_t right, int16_t bottom)
 {
     if (!renderer)
         return;
 
-    if (image->hw_image && ((pt_image_sdl*)image->hw_image)->revision != pt_sys.palette_revision) {
+    if (image->hw_image && !sdlvideo_image_is_current((pt_image_sdl*)image->hw_image)) {
         sdlvideo_destroy_hw_image(image->hw_image);
         image->hw_image = NULL;
     }
@@ -242,12 +624,7 @@ void sdlvideo_blit_image(
         // log_print("Rectangle off screen\n");
         return;
     }
-
-    SDL_FlipMode flip = SDL_FLIP_NONE;
-    if (flags & FLIP_H)
-        flip |= SDL_FLIP_HORIZONTAL;
-    if (flags & FLIP_V)
-        flip |= SDL_FLIP_VERTICAL;
+    dirty_log_image(image, &ir, x, y, flags);
 
     // after the image rect has been clipped, flip it if required
     if (flags & FLIP_H) {
@@ -262,14 +639,33 @@ void sdlvideo_blit_image(
         ir.top = image->height - tmp;
     }
 
-    SDL_FRect srcrect = { ir.left, ir.top, rect_width(&ir), rect_height(&ir) };
-    SDL_FRect dstrect = { x, y, rect_width(&ir), rect_height(&ir) };
-
     // if (image->path && strcmp(image->path, "assets/bridge/bridge.png") == 0)
     //     log_print("(%d,%d) (%d,%d) %dx%d l=%d, r=%d\n", ir.left, ir.top, x, y, rect_width(&ir), rect_height(&ir),
     //     left, right);
 
-    SDL_RenderTextureRotated(renderer, hw_image->texture, &srcrect, &dstrect, 0.0, NULL, flip);
+    if (!hw_image || !hw_image->texture)
+        return;
+    sdl_draw_op* op = sdlvideo_push_op(SDL_DRAW_TEXTURE);
+    if (!op)
+        return;
+    float tex_w = (hw_image->page >= 0) ? ATLAS_PAGE_SIZE : hw_image->width + 2;
+    float tex_h = (hw_image->page >= 0) ? ATLAS_PAGE_SIZE : hw_image->height + 2;
+    op->texture = hw_image->texture;
+    op->u0 = (hw_image->x + ir.left) / tex_w;
+    op->v0 = (hw_image->y + ir.top) / tex_h;
+    op->u1 = (hw_image->x + ir.right) / tex_w;
+    op->v1 = (hw_image->y + ir.bottom) / tex_h;
+    if (flags & FLIP_H) {
+        float tmp = op->u0;
+        op->u0 = op->u1;
+        op->u1 = tmp;
+    }
+    if (flags & FLIP_V) {
+        float tmp = op->v0;
+        op->v0 = op->v1;
+        op->v1 = tmp;
+    }
+    op->dstrect = (SDL_FRect) { x, y, rect_width(&ir), rect_height(&ir) };
 }
 
 void sdlvideo_blit_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, pt_colour_rgb* colour)
@@ -277,19 +673,186 @@ void sdlvideo_blit_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, pt_colou
     if (!renderer)
         return;
 
-    SDL_SetRenderDrawColor(renderer, colour->r, colour->g, colour->b, SDL_ALPHA_OPAQUE);
-    SDL_RenderLine(renderer, (float)x0, (float)y0, (float)x1, (float)y1);
+    sdl_draw_op* op = sdlvideo_push_op(SDL_DRAW_LINE);
+    if (!op)
+        return;
+    // Draw with a palette slot like the other drivers, so fades and cycles apply
+    op->colour = map_colour(colour->r, colour->g, colour->b);
+    op->x0 = x0;
+    op->y0 = y0;
+    op->x1 = x1;
+    op->y1 = y1;
+    dirty_log_line(x0, y0, x1, y1, (colour->r << 16) | (colour->g << 8) | colour->b);
 }
 
+static void sdlvideo_flush_batch()
+{
+    if (batch_count) {
+        SDL_RenderGeometry(
+            renderer, batch_texture, batch_verts, (int)(batch_count * 4), batch_indices, (int)(batch_count * 6));
+    }
+    batch_count = 0;
+    batch_texture = NULL;
+}
+
+static void sdlvideo_batch_quad(sdl_draw_op* op)
+{
+    if ((op->texture != batch_texture) || (batch_count == batch_size)) {
+        sdlvideo_flush_batch();
+        if (batch_count == batch_size) {
+            size_t size = batch_size ? batch_size * 2 : 256;
+            SDL_Vertex* verts = (SDL_Vertex*)realloc(batch_verts, sizeof(SDL_Vertex) * 4 * size);
+            if (verts)
+                batch_verts = verts;
+            int* indices = (int*)realloc(batch_indices, sizeof(int) * 6 * size);
+            if (indices)
+                batch_indices = indices;
+            if (!verts || !indices) {
+                log_print("sdlvideo_batch_quad: out of memory\n");
+                return;
+            }
+            batch_size = size;
+        }
+        batch_texture = op->texture;
+    }
+
+    SDL_FColor white = { 1.0f, 1.0f, 1.0f, 1.0f };
+    float x0 = op->dstrect.x;
+    float y0 = op->dstrect.y;
+    float x1 = op->dstrect.x + op->dstrect.w;
+    float y1 = op->dstrect.y + op->dstrect.h;
+    SDL_Vertex* v = &batch_verts[batch_count * 4];
+    v[0] = (SDL_Vertex) { { x0, y0 }, white, { op->u0, op->v0 } };
+    v[1] = (SDL_Vertex) { { x1, y0 }, white, { op->u1, op->v0 } };
+    v[2] = (SDL_Vertex) { { x1, y1 }, white, { op->u1, op->v1 } };
+    v[3] = (SDL_Vertex) { { x0, y1 }, white, { op->u0, op->v1 } };
+    int base = (int)(batch_count * 4);
+    int* idx = &batch_indices[batch_count * 6];
+    idx[0] = base;
+    idx[1] = base + 1;
+    idx[2] = base + 2;
+    idx[3] = base;
+    idx[4] = base + 2;
+    idx[5] = base + 3;
+    batch_count++;
+}
+
+static void sdlvideo_replay(SDL_Rect* clip)
+{
+    SDL_SetRenderClipRect(renderer, clip);
+    for (size_t i = 0; i < draw_ops_count; i++) {
+        sdl_draw_op* op = &draw_ops[i];
+        if (op->type != SDL_DRAW_TEXTURE)
+            sdlvideo_flush_batch();
+        switch (op->type) {
+        case SDL_DRAW_CLEAR: {
+            // SDL_RenderClear ignores the clip rectangle
+            SDL_FRect fill = { clip->x, clip->y, clip->w, clip->h };
+            SDL_Color colour = sdlvideo_slot_colour(op->colour);
+            SDL_SetRenderDrawColor(renderer, colour.r, colour.g, colour.b, colour.a);
+            SDL_RenderFillRect(renderer, &fill);
+        } break;
+        case SDL_DRAW_TEXTURE:
+            sdlvideo_batch_quad(op);
+            break;
+        case SDL_DRAW_LINE: {
+            SDL_Color colour = sdlvideo_slot_colour(op->colour);
+            SDL_SetRenderDrawColor(renderer, colour.r, colour.g, colour.b, colour.a);
+            SDL_RenderLine(renderer, op->x0, op->y0, op->x1, op->y1);
+        } break;
+        default:
+            break;
+        }
+    }
+    sdlvideo_flush_batch();
+    SDL_SetRenderClipRect(renderer, NULL);
+}
+
+#ifndef SDL_INDEXED_TEXTURES
+// Read the changed areas of the framebuffer back as palette indices,
+// then upload their colours. If the palette has changed, redo the lot.
+static void sdlvideo_lookup(struct rect* rects, size_t rect_count)
+{
+    if (!lookup_texture || !lookup_indices || !lookup_pixels)
+        return;
+
+    for (size_t i = 0; i < rect_count; i++) {
+        SDL_Rect area = { rects[i].left, rects[i].top, rect_width(&rects[i]), rect_height(&rects[i]) };
+        SDL_Surface* surface = SDL_RenderReadPixels(renderer, &area);
+        SDL_Surface* argb = surface ? SDL_ConvertSurface(surface, SDL_PIXELFORMAT_ARGB8888) : NULL;
+        if (surface)
+            SDL_DestroySurface(surface);
+        if (!argb) {
+            log_print("sdlvideo_lookup: failed to read framebuffer: %s\n", SDL_GetError());
+            continue;
+        }
+        for (int y = 0; y < MIN(argb->h, area.h); y++) {
+            uint32_t* src = (uint32_t*)((byte*)argb->pixels + y * argb->pitch);
+            byte* dest = lookup_indices + (area.y + y) * SCREEN_WIDTH + area.x;
+            for (int x = 0; x < MIN(argb->w, area.w); x++) {
+                dest[x] = src[x] & 0xff;
+            }
+        }
+        SDL_DestroySurface(argb);
+    }
+
+    uint32_t lookup[256];
+    for (int i = 0; i < 256; i++) {
+        pt_colour_rgb* c = &pt_sys.palette_display[i];
+        lookup[i] = (c->r << 16) | (c->g << 8) | c->b;
+    }
+    struct rect all = { 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT };
+    if (lookup_all) {
+        rects = &all;
+        rect_count = 1;
+        lookup_all = false;
+    }
+    for (size_t i = 0; i < rect_count; i++) {
+        struct rect* r = &rects[i];
+        for (int y = r->top; y < r->bottom; y++) {
+            byte* src = lookup_indices + y * SCREEN_WIDTH;
+            uint32_t* dest = lookup_pixels + y * SCREEN_WIDTH;
+            for (int x = r->left; x < r->right; x++) {
+                dest[x] = lookup[src[x]];
+            }
+        }
+        SDL_Rect area = { r->left, r->top, rect_width(r), rect_height(r) };
+        SDL_UpdateTexture(lookup_texture, &area, lookup_pixels + r->top * SCREEN_WIDTH + r->left,
+            SCREEN_WIDTH * sizeof(uint32_t));
+    }
+}
+#endif
+
 void sdlvideo_blit()
 {
     if (!renderer)
         return;
 
+    // The framebuffer texture keeps its contents between frames,
+    // so only redraw the areas that have changed.
+    struct rect* rects = NULL;
+    size_t rect_count = dirty_end_frame(1, &rects);
+    for (size_t i = 0; i < rect_count; i++) {
+        SDL_Rect clip = { rects[i].left, rects[i].top, rect_width(&rects[i]), rect_height(&rects[i]) };
+        sdlvideo_replay(&clip);
+    }
+#ifndef SDL_INDEXED_TEXTURES
+    sdlvideo_lookup(rects, rect_count);
+#endif
+    draw_ops_count = 0;
+    sdlvideo_empty_graveyard();
+    sdlvideo_atlas_reclaim();
+
     // SDL renderer manages the frame buffer for us
     SDL_SetRenderTarget(renderer, NULL);
-    sdlvideo_clear();
+    pt_colour_rgb* fill = &pt_sys.palette_display[pt_sys.overscan];
+    SDL_SetRenderDrawColor(renderer, fill->r, fill->g, fill->b, SDL_ALPHA_OPAQUE);
+    SDL_RenderClear(renderer);
+#ifdef SDL_INDEXED_TEXTURES
     SDL_RenderTexture(renderer, framebuffer, NULL, NULL);
+#else
+    SDL_RenderTexture(renderer, lookup_texture, NULL, NULL);
+#endif
 }
 
 void sdlvideo_flip()
@@ -303,21 +866,28 @@ void sdlvideo_flip()
 
 void sdlvideo_update_palette_slot(uint8_t idx)
 {
-    // Game is actually rendering in 32-bit colour,
-    // we don't need to update state
-    // set_dither_from_remapper(idx, &pt_sys.dither[idx]);
+    // New slots can't be in use by anything drawn yet
+    if (idx < colour_top) {
+#ifdef SDL_INDEXED_TEXTURES
+        dirty_mark_all();
+#else
+        // The framebuffer holds palette indices, so only the lookup needs redoing
+        lookup_all = true;
+#endif
+    } else {
+        colour_top = idx + 1;
+    }
+
+    if (image_palette) {
+        pt_colour_rgb* c = &pt_sys.palette_display[idx];
+        SDL_Color colour = { c->r, c->g, c->b, SDL_ALPHA_OPAQUE };
+        SDL_SetPaletteColors(image_palette, &colour, idx, 1);
+    }
 }
 
 void sdlvideo_set_palette_remapper(enum pt_palette_remapper remapper, enum pt_palette_remapper_mode mode)
 {
-    pt_sys.remapper = remapper;
-    pt_sys.remapper_mode = mode;
-    for (int i = 0; i < pt_sys.palette_top; i++) {
-        set_dither_from_remapper(remapper, mode, i, &pt_sys.dither[i]);
-    }
-
-    // Force all hardware images to be recalculated
-    pt_sys.palette_revision++;
+    palette_set_remapper(remapper, mode);
 }
 
 void sdlvideo_set_overscan_colour(pt_colour_rgb* colour)
@@ -332,7 +902,183 @@ void sdlvideo_get_screen_dims(uint16_t* w, uint16_t* h)
 
 pt_drv_video sdl_video = { &sdlvideo_init, &sdlvideo_shutdown, &sdlvideo_clear, &sdlvideo_blit_image,
     &sdlvideo_blit_line, &sdlvideo_blit, &sdlvideo_flip, &sdlvideo_update_palette_slot, &sdlvideo_destroy_hw_image,
-    &sdlvideo_set_palette_remapper, &sdlvideo_set_overscan_colour, sdlvideo_get_screen_dims };
+    &sdlvideo_set_palette_remapper, &sdlvideo_set_overscan_colour, sdlvideo_get_screen_dims, NULL, NULL };
+
+// Software renderer; composites into an 8-bit framebuffer the same way as the
+// DOS VGA driver, then uploads the result to a single streaming texture.
+static SDL_Texture* soft_texture = NULL;
+static uint32_t* soft_pixels = NULL;
+
+void sdlsoft_shutdown();
+
+void sdlsoft_init()
+{
+    if (window)
+        return;
+
+    if (!sdlvideo_create_window())
+        return;
+    soft_texture = SDL_CreateTexture(
+        renderer, SDL_PIXELFORMAT_XRGB8888, SDL_TEXTUREACCESS_STREAMING, SCREEN_WIDTH, SCREEN_HEIGHT);
+    if (!soft_texture) {
+        log_print("sdlsoft_init: Failed to create texture: %s\n", SDL_GetError());
+    } else {
+        SDL_SetTextureScaleMode(soft_texture, SDL_SCALEMODE_NEAREST);
+    }
+    soft_pixels = (uint32_t*)calloc(SCREEN_WIDTH * SCREEN_HEIGHT, sizeof(uint32_t));
+    colour_top = pt_sys.palette_top;
+    linear_init(SCREEN_WIDTH, SCREEN_HEIGHT);
+    atexit(sdlsoft_shutdown);
+}
+
+void sdlsoft_shutdown()
+{
+    if (!window)
+        return;
+
+    linear_shutdown();
+    if (soft_pixels) {
+        free(soft_pixels);
+        soft_pixels = NULL;
+    }
+    if (soft_texture) {
+        SDL_DestroyTexture(soft_texture);
+        soft_texture = NULL;
+    }
+    sdlvideo_destroy_window();
+}
+
+void sdlsoft_clear()
+{
+    linear_clear(pt_sys.overscan);
+}
+
+void sdlsoft_blit_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, pt_colour_rgb* colour)
+{
+    linear_blit_line(x0, y0, x1, y1, map_colour(colour->r, colour->g, colour->b));
+}
+
+void sdlsoft_blit()
+{
+    if (!renderer)
+        return;
+
+    byte* fb = linear_get_framebuffer();
+    if (!fb || !soft_texture || !soft_pixels)
+        return;
+
+    // Only the changed areas need converting and uploading
+    struct rect* rects = NULL;
+    size_t rect_count = dirty_end_frame(1, &rects);
+    if (rect_count) {
+        uint32_t lookup[256];
+        for (int i = 0; i < 256; i++) {
+            pt_colour_rgb* c = &pt_sys.palette_display[i];
+            lookup[i] = (c->r << 16) | (c->g << 8) | c->b;
+        }
+        for (size_t i = 0; i < rect_count; i++) {
+            struct rect* r = &rects[i];
+            for (int y = r->top; y < r->bottom; y++) {
+                byte* src = fb + y * SCREEN_WIDTH;
+                uint32_t* dest = soft_pixels + y * SCREEN_WIDTH;
+                for (int x = r->left; x < r->right; x++) {
+                    dest[x] = lookup[src[x]];
+                }
+            }
+            SDL_Rect area = { r->left, r->top, rect_width(r), rect_height(r) };
+            SDL_UpdateTexture(soft_texture, &area, soft_pixels + r->top * SCREEN_WIDTH + r->left,
+                SCREEN_WIDTH * sizeof(uint32_t));
+        }
+    }
+
+    pt_colour_rgb* fill = &pt_sys.palette_display[pt_sys.overscan];
+    SDL_SetRenderDrawColor(renderer, fill->r, fill->g, fill->b, SDL_ALPHA_OPAQUE);
+    SDL_RenderClear(renderer);
+    SDL_RenderTexture(renderer, soft_texture, NULL, NULL);
+}
+
+void sdlsoft_update_palette_slot(uint8_t idx)
+{
+    // The framebuffer holds palette indices, so only the on-screen colours need redoing
+    if (idx < colour_top)
+        dirty_mark_all();
+    else
+        colour_top = idx + 1;
+}
+
+void sdlsoft_flip()
+{
+    if (!renderer)
+        return;
+
+    SDL_RenderPresent(renderer);
+}
+
+pt_drv_video sdl_video_soft = { &sdlsoft_init, &sdlsoft_shutdown, &sdlsoft_clear, &linear_blit_image,
+    &sdlsoft_blit_line, &sdlsoft_blit, &sdlsoft_flip, &sdlsoft_update_palette_slot, &linear_destroy_hw_image,
+    &sdlvideo_set_palette_remapper, &sdlvideo_set_overscan_colour, sdlvideo_get_screen_dims, &linear_save_layer,
+    &linear_restore_layer };
+
+// Mode X renderer; runs the DOS VGA pipeline against an emulated card,
+// then scans out the displayed page to the same streaming texture.
+void sdlmodex_shutdown();
+
+void sdlmodex_init()
+{
+    if (window)
+        return;
+
+    if (!sdlvideo_create_window())
+        return;
+    soft_texture = SDL_CreateTexture(
+        renderer, SDL_PIXELFORMAT_XRGB8888, SDL_TEXTUREACCESS_STREAMING, MODEX_WIDTH, MODEX_HEIGHT);
+    if (!soft_texture) {
+        log_print("sdlmodex_init: Failed to create texture: %s\n", SDL_GetError());
+    } else {
+        SDL_SetTextureScaleMode(soft_texture, SDL_SCALEMODE_NEAREST);
+    }
+    soft_pixels = (uint32_t*)calloc(MODEX_WIDTH * MODEX_HEIGHT, sizeof(uint32_t));
+    modex_init(&vgaemu_hal);
+    atexit(sdlmodex_shutdown);
+}
+
+void sdlmodex_shutdown()
+{
+    if (!window)
+        return;
+
+    modex_shutdown();
+    if (soft_pixels) {
+        free(soft_pixels);
+        soft_pixels = NULL;
+    }
+    if (soft_texture) {
+        SDL_DestroyTexture(soft_texture);
+        soft_texture = NULL;
+    }
+    sdlvideo_destroy_window();
+}
+
+void sdlmodex_flip()
+{
+    if (!renderer)
+        return;
+
+    modex_flip();
+    if (soft_texture && soft_pixels) {
+        vgaemu_scanout(soft_pixels, MODEX_WIDTH);
+        SDL_UpdateTexture(soft_texture, NULL, soft_pixels, MODEX_WIDTH * sizeof(uint32_t));
+    }
+    uint32_t fill = vgaemu_get_overscan();
+    SDL_SetRenderDrawColor(renderer, (fill >> 16) & 0xff, (fill >> 8) & 0xff, fill & 0xff, SDL_ALPHA_OPAQUE);
+    SDL_RenderClear(renderer);
+    SDL_RenderTexture(renderer, soft_texture, NULL, NULL);
+    SDL_RenderPresent(renderer);
+}
+
+pt_drv_video sdl_video_modex = { &sdlmodex_init, &sdlmodex_shutdown, &modex_clear, &modex_blit_image, &modex_blit_line,
+    &modex_blit, &sdlmodex_flip, &modex_update_palette_slot, &planar_destroy_hw_image, &modex_set_palette_remapper,
+    &modex_set_overscan_colour, &modex_get_screen_dims, &modex_save_layer, &modex_restore_layer };
 
 void sdltimer_init()
 {
@@ -432,6 +1178,11 @@ void sdlkeyboard_update()
     SDL_Event ev;
     while (SDL_PollEvent(&ev)) {
         switch (ev.type) {
+        case SDL_EVENT_RENDER_TARGETS_RESET:
+        case SDL_EVENT_RENDER_DEVICE_RESET:
+            // Contents of the framebuffer texture have been lost
+            dirty_mark_all();
+            break;
         case SDL_EVENT_QUIT:
             event_push(EVENT_QUIT);
             break;
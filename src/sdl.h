@@ -16,11 +16,23 @@ typedef struct pt_image_sdl pt_image_sdl;
 
 struct pt_image_sdl {
     SDL_Texture* texture;
-    int revision;
+    pt_palette_deps deps;
+    // Atlas page the image was packed into, or -1 if it has its own texture
+    int page;
+    uint32_t generation;
+    // Location of the image in the texture, in texels
+    int16_t x;
+    int16_t y;
+    int16_t width;
+    int16_t height;
 };
 
 extern pt_drv_video sdl_video;
 
+extern pt_drv_video sdl_video_soft;
+
+extern pt_drv_video sdl_video_modex;
+
 extern pt_drv_timer sdl_timer;
 
 extern pt_drv_beep sdl_beep;
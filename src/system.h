@@ -118,6 +118,10 @@ struct pt_drv_video {
     void (*set_palette_remapper)(enum pt_palette_remapper remapper, enum pt_palette_remapper_mode mode);
     void (*set_overscan_colour)(pt_colour_rgb* colour);
     void (*get_screen_dims)(uint16_t* w, uint16_t* h);
+    // Optional; keep a copy of the whole framebuffer, and copy it back later.
+    // Used to cache the static part of the room. Either can be NULL.
+    bool (*save_layer)();
+    bool (*restore_layer)();
 };
 
 struct pt_system {
@@ -130,8 +134,15 @@ struct pt_system {
     pt_drv_beep* beep;
     pt_drv_video* video;
     int palette_top;
+    // Bumped whenever the colour mapping of an existing palette slot changes
     int palette_revision;
+    // Value of palette_revision when each slot last changed
+    int slot_revision[256];
+    // Bumped by palette_init, when every slot gets handed out again
+    int palette_epoch;
     pt_colour_rgb palette[256];
+    // Colours being shown for each palette slot, after palette effects
+    pt_colour_rgb palette_display[256];
     enum pt_palette_remapper remapper;
     enum pt_palette_remapper_mode remapper_mode;
     uint8_t overscan;
@@ -3,8 +3,11 @@
 
 #include "log.h"
 #include "rect.h"
+#include "system.h"
 #include "text.h"
 
+static uint32_t text_serial = 0;
+
 uint32_t iter_utf8(const byte** str)
 {
     uint32_t result = 0;
@@ -73,41 +76,27 @@ uint32_t iter_utf8(const byte** str)
     return result;
 }
 
-pt_text_word* create_newline()
+// Fill in a word's glyphs, which are written to glyphs.
+// There needs to be room for one glyph per byte of the string.
+static void text_layout_word(pt_text_word* word, pt_text_glyph* glyphs, const byte* string, size_t length, pt_font* font)
 {
-    pt_text_word* word = (pt_text_word*)calloc(1, sizeof(pt_text_word));
-    word->newline = true;
-    return word;
-}
-
-pt_text_word* create_text_word(const byte* string, size_t length, pt_font* font)
-{
-    if (!string || !font)
-        return NULL;
-
-    pt_text_word* word = (pt_text_word*)calloc(1, sizeof(pt_text_word));
     // add bodge for outline
     word->width = font->outline;
     word->height = font->common.line_height + (font->outline * 2);
     word->newline = false;
+    word->glyphs = glyphs;
+    word->glyph_count = 0;
     const byte* ptr = string;
     const byte* end = string + length;
 
     while (ptr < end) {
         uint32_t codepoint = iter_utf8(&ptr);
         // log_print("create_text_word: %x\n", codepoint);
-        int char_idx = -1;
-        for (int i = 0; i < font->char_count; i++) {
-            if (font->chars[i].id == codepoint) {
-                char_idx = i;
-                break;
-            }
-        }
+        int char_idx = font_find_char(font, codepoint);
         if (char_idx == -1) {
             log_print("create_text_word: missing character for codepoint %x\n", codepoint);
             continue;
         }
-        word->glyphs = (pt_text_glyph*)realloc(word->glyphs, sizeof(pt_text_glyph) * (word->glyph_count + 1));
         word->glyphs[word->glyph_count].char_idx = char_idx;
         word->glyphs[word->glyph_count].x = word->width;
         word->glyphs[word->glyph_count].y = font->chars[char_idx].yoffset + font->outline;
@@ -116,6 +105,22 @@ pt_text_word* create_text_word(const byte* string, size_t length, pt_font* font)
             word->width++;
         word->glyph_count += 1;
     }
+}
+
+pt_text_word* create_text_word(const byte* string, size_t length, pt_font* font)
+{
+    if (!string || !font)
+        return NULL;
+
+    pt_text_word* word = (pt_text_word*)calloc(1, sizeof(pt_text_word));
+    pt_text_glyph* glyphs = (pt_text_glyph*)calloc(length ? length : 1, sizeof(pt_text_glyph));
+    if (!word || !glyphs) {
+        log_print("create_text_word: out of memory\n");
+        free(word);
+        free(glyphs);
+        return NULL;
+    }
+    text_layout_word(word, glyphs, string, length, font);
     return word;
 }
 
@@ -129,81 +134,106 @@ static inline bool is_whitespace_except_newline(byte c)
     return ((c == ' ') || (c == '\t') || (c == '\r'));
 }
 
-pt_text* create_text(const byte* string, size_t length, pt_font* font, uint16_t width, enum pt_text_align align)
+// Split off the next word from the string, and skip the whitespace after it.
+// Newlines are returned as a zero-length word starting with '\n'.
+static inline const byte* text_next_word(const byte* ptr, const byte* end, size_t* word_len)
 {
-    pt_text* text = (pt_text*)calloc(1, sizeof(pt_text));
-    text->font = font;
-    text->width = width;
-    if (length == 0)
-        return text;
+    if (*ptr == '\n') {
+        *word_len = 0;
+        return ptr + 1;
+    }
+    const byte* test = ptr;
+    while ((test < end) && !is_whitespace(*test)) {
+        test++;
+    }
+    *word_len = test - ptr;
+    ptr = test;
+    while ((ptr < end) && is_whitespace_except_newline(*ptr)) {
+        ptr++;
+    }
+    return ptr;
+}
 
-    const byte* ptr = string;
+pt_text* create_text(const byte* string, size_t length, pt_font* font, uint16_t width, enum pt_text_align align)
+{
     const byte* end = string + length;
 
-    pt_text_word** words = NULL;
+    // Measure first, so that everything can be allocated in one go.
+    // Each word can start at most one new line, and each glyph takes
+    // at least one byte of the string.
     size_t word_count = 0;
+    size_t glyph_count = 0;
+    const byte* ptr = string;
     while (ptr < end) {
-        if (*ptr == '\n') {
-            pt_text_word* word = create_newline();
-            words = (pt_text_word**)realloc(words, sizeof(pt_text_word*) * (word_count + 1));
-            words[word_count] = word;
-            word_count++;
-            ptr++;
-            continue;
-        }
-        const byte* test = ptr;
-        while ((test < end) && !is_whitespace(*test)) {
-            test++;
-        }
-        size_t word_len = test - ptr;
-        // log_print("create_text: found %d char word\n", word_len);
-        pt_text_word* word = create_text_word(ptr, word_len, font);
-        // log_print("create_text: word size: %dx%d\n", word->width, word->height);
-        words = (pt_text_word**)realloc(words, sizeof(pt_text_word*) * (word_count + 1));
-        words[word_count] = word;
+        size_t word_len = 0;
+        ptr = text_next_word(ptr, end, &word_len);
         word_count++;
-        ptr = test;
-        while ((ptr < end) && is_whitespace_except_newline(*ptr)) {
-            ptr++;
-        }
+        glyph_count += word_len;
     }
+    size_t line_count = word_count + 1;
 
-    // Get the font-defined width of a space character.
-    uint16_t space_width = 8;
-    for (int i = 0; i < font->char_count; i++) {
-        if (font->chars[i].id == 0x20) {
-            space_width = font->chars[i].width;
-            break;
-        }
+    // The parts are ordered so that each one stays aligned
+    size_t size = sizeof(pt_text) + sizeof(pt_text_line*) * line_count + sizeof(pt_text_line) * line_count
+        + sizeof(pt_text_word*) * word_count + sizeof(pt_text_word) * word_count
+        + sizeof(pt_text_glyph) * glyph_count;
+    byte* block = (byte*)calloc(1, size);
+    if (!block) {
+        log_print("create_text: out of memory\n");
+        return NULL;
     }
+    pt_text* text = (pt_text*)block;
+    pt_text_line** line_list = (pt_text_line**)(text + 1);
+    pt_text_line* lines = (pt_text_line*)(line_list + line_count);
+    pt_text_word** word_list = (pt_text_word**)(lines + line_count);
+    pt_text_word* words = (pt_text_word*)(word_list + word_count);
+    pt_text_glyph* glyphs = (pt_text_glyph*)(words + word_count);
+    pt_text_glyph* glyphs_start = glyphs;
 
-    if (!word_count) {
-        if (words) {
-            for (int j = 0; j < word_count; j++) {
-                destroy_text_word(words[j]);
-            }
-            free(words);
-        }
+    text->font = font;
+    text->width = width;
+    text->serial = ++text_serial;
+    if (!word_count)
         return text;
-    }
+
+    // Get the font-defined width of a space character.
+    uint16_t space_width = 8;
+    int space_idx = font_find_char(font, 0x20);
+    if (space_idx >= 0)
+        space_width = font->chars[space_idx].width;
 
     uint16_t x_cursor = 0;
     uint16_t y_cursor = 0;
-    text->lines = (pt_text_line**)calloc(1, sizeof(pt_text_line*));
+    text->lines = line_list;
     text->line_count = 1;
-    text->lines[0] = (pt_text_line*)calloc(1, sizeof(pt_text_line));
+    text->lines[0] = &lines[0];
     pt_text_line* line_ptr = text->lines[0];
     line_ptr->y = y_cursor;
     line_ptr->height = font->common.line_height + font->outline * 2;
-    for (int i = 0; i < word_count; i++) {
+    line_ptr->words = word_list;
+    size_t words_used = 0;
+
+    ptr = string;
+    while (ptr < end) {
+        bool newline = (*ptr == '\n');
+        size_t word_len = 0;
+        const byte* next = text_next_word(ptr, end, &word_len);
+        pt_text_word* word = NULL;
+        if (!newline) {
+            word = &words[words_used];
+            text_layout_word(word, glyphs, ptr, word_len, font);
+            glyphs += word->glyph_count;
+        }
+        ptr = next;
+        uint16_t word_width = word ? word->width : 0;
+
         // Words that are bigger than the bounding width should overflow.
-        if (words[i]->width > text->width) {
-            // log_print("create_text: resizing width from %d to %d\n", text->width, words[i]->width);
-            text->width = words[i]->width;
+        if (word_width > text->width) {
+            // log_print("create_text: resizing width from %d to %d\n", text->width, word_width);
+            text->width = word_width;
         }
 
         // If we run out of horizontal space, or hit a newline
-        if (words[i]->newline || (words[i]->width + x_cursor > text->width)) {
+        if (newline || (word_width + x_cursor > text->width)) {
 
             // For words other than the first word, set the final dims of the line.
             if (line_ptr->word_count > 0) {
@@ -216,33 +246,30 @@ pt_text* create_text(const byte* string, size_t length, pt_font* font, uint16_t
             if (!font->outline)
                 y_cursor += 2;
 
-            // resize the lines list, create a new line
-            text->lines = (pt_text_line**)realloc(text->lines, sizeof(pt_text_line*) * (text->line_count + 1));
-            text->lines[text->line_count] = (pt_text_line*)calloc(1, sizeof(pt_text_line));
-            line_ptr = text->lines[text->line_count];
+            // start a new line; its words follow on from the last line's
+            line_ptr = &lines[text->line_count];
+            text->lines[text->line_count] = line_ptr;
             line_ptr->y = y_cursor;
             line_ptr->height = font->common.line_height + font->outline * 2;
+            line_ptr->words = word_list + words_used;
             text->line_count++;
         }
 
         // Newlines don't count as a word.
-        // We don't transfer ownership, so destroy it here.
-        if (words[i]->newline) {
-            destroy_text_word(words[i]);
-            words[i] = NULL;
+        if (newline)
             continue;
-        }
 
-        words[i]->x = x_cursor;
-        x_cursor += words[i]->width + space_width;
-        line_ptr->words = (pt_text_word**)realloc(line_ptr->words, sizeof(pt_text_word*) * (line_ptr->word_count + 1));
-        line_ptr->words[line_ptr->word_count] = words[i];
+        word->x = x_cursor;
+        x_cursor += word->width + space_width;
+        word_list[words_used] = word;
+        words_used++;
         line_ptr->word_count++;
     }
     if (line_ptr->word_count > 0) {
         pt_text_word* last_word = line_ptr->words[line_ptr->word_count - 1];
         line_ptr->width = last_word->x + last_word->width;
     }
+    text->glyph_count = glyphs - glyphs_start;
 
     // log_print("create_text: resizing height from %d to %d + %d\n", text->height, line_ptr->y, line_ptr->height);
     text->height = line_ptr->y + line_ptr->height;
@@ -257,40 +284,30 @@ pt_text* create_text(const byte* string, size_t length, pt_font* font, uint16_t
             }
         }
     }
-    free(words);
     return text;
 }
 
-pt_image* text_to_image(pt_text* text, uint8_t r, uint8_t g, uint8_t b, uint8_t brd_r, uint8_t brd_g, uint8_t brd_b)
+// OR glyphs start to end (in reading order) of the text into an image
+// made by text_render_image
+static void text_render_glyphs(pt_text* text, pt_image* image, size_t start, size_t end)
 {
-    if (!text)
-        return NULL;
-    pt_image* image = create_image(NULL, 0, 0, 0);
-    if (!image)
-        return NULL;
-    image->width = text->width;
-    image->height = text->height;
-    image->pitch = get_pitch(text->width);
-    image->data = (byte*)calloc(image->pitch * image->height, sizeof(byte));
-    image->palette[0x7f * 3] = brd_r;
-    image->palette[0x7f * 3 + 1] = brd_g;
-    image->palette[0x7f * 3 + 2] = brd_b;
-    image->palette[0xff * 3] = r;
-    image->palette[0xff * 3 + 1] = g;
-    image->palette[0xff * 3 + 2] = b;
-    // log_print("text_to_image: creating %dx%d bitmap (%d bytes)\n", image->width, image->height, image->pitch *
-    // image->height);
-
     struct rect* char_rect = create_rect();
     struct rect* crop = create_rect_dims(image->width, image->height);
 
-    for (int i = 0; i < text->line_count; i++) {
+    size_t index = 0;
+    for (int i = 0; (i < text->line_count) && (index < end); i++) {
         pt_text_line* line = text->lines[i];
         // log_print("text_to_image: line %d, ypos=%d, %dx%d\n", i, line->y, line->width, line->height);
-        for (int j = 0; j < line->word_count; j++) {
+        for (int j = 0; (j < line->word_count) && (index < end); j++) {
             pt_text_word* word = line->words[j];
             // log_print("text_to_image: word %d, xpos=%d, %dx%d\n", j, word->x, word->width, word->height);
-            for (int k = 0; k < word->glyph_count; k++) {
+            if (index + word->glyph_count <= start) {
+                index += word->glyph_count;
+                continue;
+            }
+            for (int k = 0; (k < word->glyph_count) && (index < end); k++, index++) {
+                if (index < start)
+                    continue;
                 pt_text_glyph* glyph = &word->glyphs[k];
                 // log_print("font %d %d %p\n", k, glyph->char_idx);
                 pt_font_char* fchar = &text->font->chars[glyph->char_idx];
@@ -336,9 +353,46 @@ pt_image* text_to_image(pt_text* text, uint8_t r, uint8_t g, uint8_t b, uint8_t
     }
     destroy_rect(char_rect);
     destroy_rect(crop);
+}
+
+// Render the first count glyphs of the text to a new image
+static pt_image* text_render_image(
+    pt_text* text, uint8_t r, uint8_t g, uint8_t b, uint8_t brd_r, uint8_t brd_g, uint8_t brd_b, size_t count)
+{
+    if (!text)
+        return NULL;
+    pt_image* image = create_image(NULL, 0, 0, 0);
+    if (!image)
+        return NULL;
+    image->width = text->width;
+    image->height = text->height;
+    image->pitch = get_pitch(text->width);
+    image->data = (byte*)calloc(image->pitch * image->height, sizeof(byte));
+    byte colours[3 * 256] = { 0 };
+    colours[0x7f * 3] = brd_r;
+    colours[0x7f * 3 + 1] = brd_g;
+    colours[0x7f * 3 + 2] = brd_b;
+    colours[0xff * 3] = r;
+    colours[0xff * 3 + 1] = g;
+    colours[0xff * 3 + 2] = b;
+    // Text in the same colours shares a palette
+    pt_image_palette* palette = create_image_palette(colours, NULL);
+    if (palette) {
+        destroy_image_palette(image->palette);
+        image->palette = palette;
+    }
+    // log_print("text_to_image: creating %dx%d bitmap (%d bytes)\n", image->width, image->height, image->pitch *
+    // image->height);
+
+    text_render_glyphs(text, image, 0, count);
     return image;
 }
 
+pt_image* text_to_image(pt_text* text, uint8_t r, uint8_t g, uint8_t b, uint8_t brd_r, uint8_t brd_g, uint8_t brd_b)
+{
+    return text_render_image(text, r, g, b, brd_r, brd_g, brd_b, SIZE_MAX);
+}
+
 void destroy_text_word(pt_text_word* word)
 {
     if (!word)
@@ -350,24 +404,278 @@ void destroy_text_word(pt_text_word* word)
     free(word);
 }
 
-void destroy_text(pt_text* text)
+// Whether the text colours come out dithered with the current remapper
+static bool text_tint_dithered(pt_font* font, pt_font_tint* tint)
 {
-    if (!text)
+    for (size_t i = 0; i < font->page_count; i++) {
+        if (!tint->body[i])
+            continue;
+        // The body pages have both the outline and body colours
+        pt_dither_map* dither_map = image_palette_get_dither_map(tint->body[i]->palette);
+        for (int j = 1; j < 8; j++) {
+            if ((dither_map->phase[j][0x7f] != dither_map->phase[0][0x7f])
+                || (dither_map->phase[j][0xff] != dither_map->phase[0][0xff]))
+                return true;
+        }
+        return false;
+    }
+    return false;
+}
+
+// Draw the first count glyphs of the text straight to the screen, one at a
+// time, from copies of the font pages tinted with the text colours.
+// With every glyph, the result is the same as drawing the image made by
+// text_to_image; with fewer, text can be revealed without laying it out again.
+void text_draw(pt_text* text, int16_t x, int16_t y, size_t count)
+{
+    if (!text || !text->font)
         return;
-    if (text->lines) {
-        for (int i = 0; i < text->line_count; i++) {
+    pt_font* font = text->font;
+    pt_font_tint* tint = font_get_tint(font, text->colours);
+    if (!tint)
+        return;
+
+    if (count > text->glyph_count)
+        count = text->glyph_count;
+
+    // Dither patterns line up with the source image, so drawing glyphs from
+    // the font pages would leave seams. Fall back to drawing a rendered copy.
+    // As the count goes up, only the new glyphs are added to the copy;
+    // it's only rendered from scratch when the count goes down.
+    if (text_tint_dithered(font, tint)) {
+        if (text->image && (text->image_glyphs > count)) {
+            destroy_image(text->image);
+            text->image = NULL;
+        }
+        if (!text->image && text->line_count) {
+            text->image = text_render_image(text, text->colours[0], text->colours[1], text->colours[2],
+                text->colours[3], text->colours[4], text->colours[5], count);
+            text->image_glyphs = count;
+        } else if (text->image && (text->image_glyphs < count)) {
+            text_render_glyphs(text, text->image, text->image_glyphs, count);
+            text->image_glyphs = count;
+            image_touch(text->image);
+        }
+        if (text->image)
+            image_blit(text->image, x, y, 0);
+        return;
+    }
+    struct rect crop = { 0, 0, text->width, text->height };
+
+    // text_to_image merges overlapping glyphs by ORing them together,
+    // so body pixels always win over outline pixels. Drawing all of the
+    // outlines first gets the same result.
+    for (int pass = 0; pass < 2; pass++) {
+        pt_image** pages = pass ? tint->body : tint->outline;
+        size_t remaining = count;
+        for (int i = 0; (i < text->line_count) && remaining; i++) {
             pt_text_line* line = text->lines[i];
-            for (int j = 0; j < line->word_count; j++) {
-                destroy_text_word(line->words[j]);
-                line->words[j] = NULL;
+            for (int j = 0; (j < line->word_count) && remaining; j++) {
+                pt_text_word* word = line->words[j];
+                for (int k = 0; (k < word->glyph_count) && remaining; k++, remaining--) {
+                    pt_text_glyph* glyph = &word->glyphs[k];
+                    pt_font_char* fchar = &font->chars[glyph->char_idx];
+                    if ((fchar->page >= font->page_count) || !pages[fchar->page])
+                        continue;
+                    int16_t gx = word->x + glyph->x;
+                    int16_t gy = line->y + glyph->y;
+                    struct rect src = { 0, 0, fchar->width, fchar->height };
+                    if (!rect_blit_clip(&gx, &gy, &src, &crop))
+                        continue;
+                    pt_sys.video->blit_image(pages[fchar->page], x + gx, y + gy, 0, fchar->x + src.left,
+                        fchar->y + src.top, fchar->x + src.right, fchar->y + src.bottom);
+                }
             }
-            free(line->words);
-            line->words = NULL;
-            free(line);
-            text->lines[i] = NULL;
         }
-        free(text->lines);
-        text->lines = NULL;
     }
+}
+
+void destroy_text(pt_text* text)
+{
+    if (!text)
+        return;
+    if (text->image)
+        destroy_image(text->image);
+    // The lines, words and glyphs are all part of the same allocation
     free(text);
 }
+
+// Cache of rendered text images, keyed on everything that goes into them.
+// Labels and hover text tend to get rendered again with the same inputs
+// every frame; handing back the same image means the driver's converted
+// copy gets reused as well.
+
+#define TEXT_CACHE_BUCKETS 64
+
+typedef struct pt_text_cache_entry pt_text_cache_entry;
+
+struct pt_text_cache_entry {
+    uint32_t hash;
+    pt_font* font;
+    byte* string;
+    size_t length;
+    uint16_t width;
+    enum pt_text_align align;
+    uint8_t colours[6];
+    pt_image* image;
+    size_t size;
+    // Hash bucket chain
+    pt_text_cache_entry* next;
+    // Most recently used first
+    pt_text_cache_entry* lru_prev;
+    pt_text_cache_entry* lru_next;
+};
+
+static pt_text_cache_entry* text_cache[TEXT_CACHE_BUCKETS] = { 0 };
+static pt_text_cache_entry* text_cache_head = NULL;
+static pt_text_cache_entry* text_cache_tail = NULL;
+static size_t text_cache_size = 0;
+static size_t text_cache_budget = TEXT_CACHE_DEFAULT_BUDGET;
+
+static uint32_t text_cache_hash(const byte* string, size_t length, pt_font* font, uint16_t width,
+    enum pt_text_align align, const uint8_t* colours)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    uintptr_t font_id = (uintptr_t)font;
+    for (size_t i = 0; i < sizeof(uintptr_t); i++) {
+        hash = (hash ^ ((font_id >> (8 * i)) & 0xff)) * 16777619u;
+    }
+    hash = (hash ^ (width & 0xff)) * 16777619u;
+    hash = (hash ^ (width >> 8)) * 16777619u;
+    hash = (hash ^ align) * 16777619u;
+    for (int i = 0; i < 6; i++) {
+        hash = (hash ^ colours[i]) * 16777619u;
+    }
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ string[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static void text_cache_lru_unlink(pt_text_cache_entry* entry)
+{
+    if (entry->lru_prev)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        text_cache_head = entry->lru_next;
+    if (entry->lru_next)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        text_cache_tail = entry->lru_prev;
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+}
+
+static void text_cache_lru_push(pt_text_cache_entry* entry)
+{
+    entry->lru_prev = NULL;
+    entry->lru_next = text_cache_head;
+    if (text_cache_head)
+        text_cache_head->lru_prev = entry;
+    text_cache_head = entry;
+    if (!text_cache_tail)
+        text_cache_tail = entry;
+}
+
+static void text_cache_remove(pt_text_cache_entry* entry)
+{
+    pt_text_cache_entry** link = &text_cache[entry->hash % TEXT_CACHE_BUCKETS];
+    while (*link && (*link != entry))
+        link = &(*link)->next;
+    if (*link)
+        *link = entry->next;
+    text_cache_lru_unlink(entry);
+    text_cache_size -= entry->size;
+    // Anyone else using the image keeps it alive
+    destroy_image(entry->image);
+    free(entry->string);
+    free(entry);
+}
+
+static void text_cache_trim()
+{
+    while (text_cache_tail && (text_cache_size > text_cache_budget))
+        text_cache_remove(text_cache_tail);
+}
+
+pt_image* create_text_image(const byte* string, size_t length, pt_font* font, uint16_t width, enum pt_text_align align,
+    uint8_t r, uint8_t g, uint8_t b, uint8_t brd_r, uint8_t brd_g, uint8_t brd_b)
+{
+    if (!string || !font)
+        return NULL;
+    uint8_t colours[6] = { r, g, b, brd_r, brd_g, brd_b };
+    uint32_t hash = text_cache_hash(string, length, font, width, align, colours);
+    pt_text_cache_entry** bucket = &text_cache[hash % TEXT_CACHE_BUCKETS];
+    for (pt_text_cache_entry* entry = *bucket; entry; entry = entry->next) {
+        if ((entry->hash != hash) || (entry->font != font) || (entry->width != width) || (entry->align != align)
+            || (entry->length != length) || memcmp(entry->colours, colours, 6) || memcmp(entry->string, string, length))
+            continue;
+        // Cached images are never changed in place; setting the origin
+        // on a shared image gives the caller a copy (create_image_copy).
+        pt_image* image = entry->image;
+        text_cache_lru_unlink(entry);
+        text_cache_lru_push(entry);
+        image->refs++;
+        return image;
+    }
+
+    pt_text* text = create_text(string, length, font, width, align);
+    pt_image* image = text_to_image(text, r, g, b, brd_r, brd_g, brd_b);
+    destroy_text(text);
+    if (!image)
+        return NULL;
+
+    size_t size = (size_t)image->pitch * image->height;
+    if (!text_cache_budget || (size > text_cache_budget))
+        return image;
+    pt_text_cache_entry* entry = (pt_text_cache_entry*)calloc(1, sizeof(pt_text_cache_entry));
+    byte* key = (byte*)malloc(length ? length : 1);
+    if (!entry || !key) {
+        log_print("create_text_image: out of memory\n");
+        free(entry);
+        free(key);
+        return image;
+    }
+    memcpy(key, string, length);
+    entry->hash = hash;
+    entry->font = font;
+    entry->string = key;
+    entry->length = length;
+    entry->width = width;
+    entry->align = align;
+    memcpy(entry->colours, colours, 6);
+    entry->image = image;
+    entry->size = size;
+    entry->next = *bucket;
+    *bucket = entry;
+    text_cache_lru_push(entry);
+    text_cache_size += size;
+    // One reference for the cache, one for the caller
+    image->refs++;
+    text_cache_trim();
+    return image;
+}
+
+void text_cache_set_budget(size_t budget)
+{
+    text_cache_budget = budget;
+    text_cache_trim();
+}
+
+void text_cache_purge_font(pt_font* font)
+{
+    pt_text_cache_entry* entry = text_cache_head;
+    while (entry) {
+        pt_text_cache_entry* next = entry->lru_next;
+        if (entry->font == font)
+            text_cache_remove(entry);
+        entry = next;
+    }
+}
+
+void text_cache_clear()
+{
+    while (text_cache_head)
+        text_cache_remove(text_cache_head);
+}
@@ -40,9 +40,19 @@ struct pt_text {
     pt_font* font; // reference, not owned
     pt_text_line** lines;
     size_t line_count;
+    // Total across all of the words; the glyphs are stored in reading order
+    size_t glyph_count;
 
     uint16_t width;
     uint16_t height;
+
+    // Colours for text_draw; body r, g, b, then outline r, g, b
+    uint8_t colours[6];
+    // Unique ID for the layout, so the renderer can tell two apart
+    uint32_t serial;
+    // Rendered copy, used by text_draw when the colours are dithered
+    pt_image* image;
+    size_t image_glyphs;
 };
 
 enum pt_text_align {
@@ -55,6 +65,16 @@ pt_text_word* create_text_word(const byte* string, size_t length, pt_font* font)
 pt_text* create_text(const byte* string, size_t length, pt_font* font, uint16_t width, enum pt_text_align align);
 pt_image* text_to_image(pt_text* text, uint8_t r, uint8_t g, uint8_t b, uint8_t brd_r, uint8_t brd_g, uint8_t brd_b);
 void destroy_text_word(pt_text_word* word);
+void text_draw(pt_text* text, int16_t x, int16_t y, size_t count);
 void destroy_text(pt_text* text);
 
+// Default memory budget for the text image cache, in bytes of image data
+#define TEXT_CACHE_DEFAULT_BUDGET 65536
+
+pt_image* create_text_image(const byte* string, size_t length, pt_font* font, uint16_t width, enum pt_text_align align,
+    uint8_t r, uint8_t g, uint8_t b, uint8_t brd_r, uint8_t brd_g, uint8_t brd_b);
+void text_cache_set_budget(size_t budget);
+void text_cache_purge_font(pt_font* font);
+void text_cache_clear();
+
 #endif
@@ -0,0 +1,126 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "utils.h"
+#include "vgaemu.h"
+
+#define VGAEMU_PLANE_SIZE 0x10000
+
+static byte* vgaemu_memory = NULL;
+static uint16_t vgaemu_start_address = 0;
+static uint16_t vgaemu_start_latched = 0;
+static bool vgaemu_retrace = false;
+static byte vgaemu_dac[256 * 3] = { 0 };
+static uint8_t vgaemu_overscan = 0;
+
+bool vgaemu_init()
+{
+    if (!vgaemu_memory) {
+        vgaemu_memory = (byte*)calloc(4 * VGAEMU_PLANE_SIZE, sizeof(byte));
+        if (!vgaemu_memory) {
+            log_print("vgaemu_init: failed to allocate video memory\n");
+            return false;
+        }
+    }
+    memset(vgaemu_memory, 0, 4 * VGAEMU_PLANE_SIZE);
+    memset(vgaemu_dac, 0, sizeof(vgaemu_dac));
+    vgaemu_start_address = 0;
+    vgaemu_start_latched = 0;
+    vgaemu_retrace = false;
+    vgaemu_overscan = 0;
+    return true;
+}
+
+void vgaemu_shutdown()
+{
+    if (vgaemu_memory) {
+        free(vgaemu_memory);
+        vgaemu_memory = NULL;
+    }
+}
+
+void vgaemu_begin_write()
+{
+}
+
+void vgaemu_end_write()
+{
+}
+
+void vgaemu_write_plane(uint8_t plane, uint16_t offset, const byte* src, uint16_t length)
+{
+    if (!vgaemu_memory || (plane > 3))
+        return;
+    // Addresses wrap around at the end of the plane, same as the hardware
+    byte* base = vgaemu_memory + plane * VGAEMU_PLANE_SIZE;
+    uint32_t first = MIN((uint32_t)length, VGAEMU_PLANE_SIZE - (uint32_t)offset);
+    memcpy(base + offset, src, first);
+    if (first < length)
+        memcpy(base, src + first, length - first);
+}
+
+void vgaemu_set_start_address(uint16_t offset)
+{
+    vgaemu_start_address = offset;
+}
+
+bool vgaemu_is_vblank()
+{
+    // There's no beam to wait for, so alternate between the display and
+    // retrace periods on every poll. The start address is latched when
+    // the retrace begins.
+    vgaemu_retrace = !vgaemu_retrace;
+    if (vgaemu_retrace)
+        vgaemu_start_latched = vgaemu_start_address;
+    return vgaemu_retrace;
+}
+
+void vgaemu_set_dac(uint8_t idx, uint8_t r, uint8_t g, uint8_t b)
+{
+    vgaemu_dac[3 * idx] = r & 0x3f;
+    vgaemu_dac[3 * idx + 1] = g & 0x3f;
+    vgaemu_dac[3 * idx + 2] = b & 0x3f;
+}
+
+void vgaemu_set_overscan(uint8_t idx)
+{
+    vgaemu_overscan = idx;
+}
+
+void vgaemu_yield()
+{
+}
+
+static inline uint32_t vgaemu_dac_rgb(uint8_t idx)
+{
+    // Scale the 6-bit DAC components up to 8 bits
+    byte* c = &vgaemu_dac[3 * idx];
+    return (((c[0] << 2) | (c[0] >> 4)) << 16) | (((c[1] << 2) | (c[1] >> 4)) << 8) | ((c[2] << 2) | (c[2] >> 4));
+}
+
+void vgaemu_scanout(uint32_t* dest, int pitch)
+{
+    if (!vgaemu_memory || !dest)
+        return;
+    uint32_t lookup[256];
+    for (int i = 0; i < 256; i++) {
+        lookup[i] = vgaemu_dac_rgb(i);
+    }
+    for (int y = 0; y < MODEX_HEIGHT; y++) {
+        uint32_t* row = dest + y * pitch;
+        uint16_t offset = vgaemu_start_latched + y * (MODEX_WIDTH >> 2);
+        for (int x = 0; x < MODEX_WIDTH; x++) {
+            row[x] = lookup[vgaemu_memory[(x & 3) * VGAEMU_PLANE_SIZE + (uint16_t)(offset + (x >> 2))]];
+        }
+    }
+}
+
+uint32_t vgaemu_get_overscan()
+{
+    return vgaemu_dac_rgb(vgaemu_overscan);
+}
+
+pt_modex_hal vgaemu_hal = { &vgaemu_init, &vgaemu_shutdown, &vgaemu_begin_write, &vgaemu_end_write,
+    &vgaemu_write_plane, &vgaemu_set_start_address, &vgaemu_is_vblank, &vgaemu_set_dac, &vgaemu_set_overscan,
+    &vgaemu_yield };
@@ -0,0 +1,20 @@
+#ifndef PERENTIE_VGAEMU_H
+#define PERENTIE_VGAEMU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "modex.h"
+
+// Emulated VGA card for the Mode X pipeline, so the DOS rendering path can
+// be run and profiled on other platforms. Models the four 64KB planes of
+// video memory, the CRTC start address (latched at the start of vblank),
+// the DAC palette and the overscan colour.
+
+extern pt_modex_hal vgaemu_hal;
+
+// Convert the page currently being displayed to 32-bit XRGB
+void vgaemu_scanout(uint32_t* dest, int pitch);
+uint32_t vgaemu_get_overscan();
+
+#endif
@@ -0,0 +1,89 @@
+// Times the OKLab nearest colour search used by the EGA/CGA dithering,
+// comparing the SIMD path in oklab_table_nearest with the plain scalar
+// search it replaced, and checks that both pick the same entries.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "colour.h"
+
+#include "dither_tables.h"
+
+#define DEFAULT_COLOURS 20000
+
+typedef struct oklab_bench_table oklab_bench_table;
+struct oklab_bench_table {
+    const char* name;
+    const pt_colour_oklab* table;
+    const float* planes;
+    int count;
+};
+
+static const oklab_bench_table tables[] = {
+    { "ega", ega_oklab, ega_oklab_planes, 16 },
+    { "half", ega_dither_half, ega_dither_half_planes, 256 },
+    { "quarter", ega_dither_quarter, ega_dither_quarter_planes, 256 },
+};
+
+static uint64_t bench_micros()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int main(int argc, char** argv)
+{
+    int colour_count = argc > 1 ? atoi(argv[1]) : DEFAULT_COLOURS;
+    if (colour_count <= 0)
+        colour_count = DEFAULT_COLOURS;
+    pt_colour_oklab* colours = (pt_colour_oklab*)calloc(colour_count, sizeof(pt_colour_oklab));
+    int* expected = (int*)calloc(colour_count, sizeof(int));
+    int* actual = (int*)calloc(colour_count, sizeof(int));
+    if (!colours || !expected || !actual) {
+        printf("out of memory\n");
+        return 1;
+    }
+    srand(1);
+    for (int i = 0; i < colour_count; i++) {
+        pt_colour_rgb rgb = { rand() % 256, rand() % 256, rand() % 256 };
+        rgb8_to_oklab(&rgb, &colours[i]);
+    }
+
+    int failures = 0;
+    for (size_t t = 0; t < sizeof(tables) / sizeof(tables[0]); t++) {
+        const oklab_bench_table* table = &tables[t];
+        float dist;
+
+        uint64_t start = bench_micros();
+        for (int i = 0; i < colour_count; i++)
+            expected[i] = oklab_table_nearest_scalar(&colours[i], table->table, table->count, &dist);
+        uint64_t scalar_time = bench_micros() - start;
+
+        start = bench_micros();
+        for (int i = 0; i < colour_count; i++)
+            actual[i] = oklab_table_nearest(&colours[i], table->planes, table->count, &dist);
+        uint64_t simd_time = bench_micros() - start;
+
+        int mismatches = 0;
+        for (int i = 0; i < colour_count; i++) {
+            if (expected[i] != actual[i]) {
+                if (mismatches < 5) {
+                    printf("%s: colour %d (%f, %f, %f): scalar picked %d, SIMD picked %d\n", table->name, i,
+                        colours[i].L, colours[i].a, colours[i].b, expected[i], actual[i]);
+                }
+                mismatches++;
+            }
+        }
+        failures += mismatches;
+        printf("%-8s %3d entries: scalar %llu us, SIMD %llu us, %d of %d matched\n", table->name, table->count,
+            (unsigned long long)scalar_time, (unsigned long long)simd_time, colour_count - mismatches,
+            colour_count);
+    }
+
+    free(colours);
+    free(expected);
+    free(actual);
+    return failures ? 1 : 0;
+}
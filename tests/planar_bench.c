@@ -0,0 +1,129 @@
+// Times the planar blitter against the linear blitter.
+// The same set of random sprites is drawn to both, with the hardware
+// images converted up front, so only the blits are measured.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "colour.h"
+#include "image.h"
+#include "linear.h"
+#include "planar.h"
+#include "system.h"
+
+#define FB_WIDTH 320
+#define FB_HEIGHT 200
+#define SPRITE_COUNT 64
+#define ROUNDS 2000
+
+static void bench_update_palette_slot(uint8_t idx)
+{
+}
+
+static pt_drv_video bench_video = { .update_palette_slot = &bench_update_palette_slot };
+
+static byte planar_fb[FB_WIDTH * FB_HEIGHT];
+
+static uint64_t bench_micros()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Character-sized sprite with a transparent border, like most game art
+static pt_image* bench_create_sprite()
+{
+    pt_image* image = create_image(NULL, 0, 0, 0);
+    image->width = 16 + rand() % 48;
+    image->height = 16 + rand() % 64;
+    image->pitch = get_pitch(image->width);
+    image->data = (byte*)calloc(image->pitch * image->height, sizeof(byte));
+    for (int y = 2; y < image->height - 2; y++) {
+        int inset = rand() % (image->width / 4 + 1);
+        for (int x = inset; x < image->width - inset; x++)
+            image->data[y * image->pitch + x] = 1 + rand() % 255;
+    }
+    byte colours[3 * 256];
+    for (int i = 0; i < 3 * 256; i++)
+        colours[i] = rand() % 256;
+    pt_image_palette* palette = create_image_palette(colours, NULL);
+    if (palette) {
+        destroy_image_palette(image->palette);
+        image->palette = palette;
+    }
+    return image;
+}
+
+int main(int argc, char** argv)
+{
+    pt_sys.video = &bench_video;
+    palette_init();
+    linear_init(FB_WIDTH, FB_HEIGHT);
+    srand(1);
+
+    pt_image* linear_images[SPRITE_COUNT];
+    pt_image* planar_images[SPRITE_COUNT];
+    int16_t xs[SPRITE_COUNT];
+    int16_t ys[SPRITE_COUNT];
+    uint8_t flags[SPRITE_COUNT];
+    for (int i = 0; i < SPRITE_COUNT; i++) {
+        linear_images[i] = bench_create_sprite();
+        // Same pixels and palette, but its own hardware image
+        pt_image* copy = create_image(NULL, 0, 0, 0);
+        copy->width = linear_images[i]->width;
+        copy->height = linear_images[i]->height;
+        copy->pitch = linear_images[i]->pitch;
+        copy->data = (byte*)malloc(copy->pitch * copy->height);
+        memcpy(copy->data, linear_images[i]->data, copy->pitch * copy->height);
+        destroy_image_palette(copy->palette);
+        copy->palette = linear_images[i]->palette;
+        copy->palette->refs++;
+        planar_images[i] = copy;
+        xs[i] = rand() % (FB_WIDTH + 32) - 16;
+        ys[i] = rand() % (FB_HEIGHT + 32) - 16;
+        flags[i] = rand() % 4;
+        linear_images[i]->hw_image = linear_convert_image(linear_images[i]);
+        planar_images[i]->hw_image = planar_convert_image(planar_images[i]);
+    }
+
+    uint64_t start = bench_micros();
+    for (int r = 0; r < ROUNDS; r++) {
+        linear_clear(0);
+        for (int i = 0; i < SPRITE_COUNT; i++) {
+            pt_image* image = linear_images[i];
+            linear_blit_image(image, xs[i], ys[i], flags[i], 0, 0, image->width, image->height);
+        }
+    }
+    uint64_t linear_time = bench_micros() - start;
+
+    start = bench_micros();
+    for (int r = 0; r < ROUNDS; r++) {
+        memset(planar_fb, 0, sizeof(planar_fb));
+        for (int i = 0; i < SPRITE_COUNT; i++) {
+            pt_image* image = planar_images[i];
+            planar_blit_image(
+                planar_fb, FB_WIDTH, FB_HEIGHT, image, xs[i], ys[i], flags[i], 0, 0, image->width, image->height);
+        }
+    }
+    uint64_t planar_time = bench_micros() - start;
+
+    int blits = ROUNDS * SPRITE_COUNT;
+    printf("linear: %llu us for %d blits (%.3f us/blit)\n", (unsigned long long)linear_time, blits,
+        (double)linear_time / blits);
+    printf("planar: %llu us for %d blits (%.3f us/blit)\n", (unsigned long long)planar_time, blits,
+        (double)planar_time / blits);
+
+    for (int i = 0; i < SPRITE_COUNT; i++) {
+        linear_destroy_hw_image(linear_images[i]->hw_image);
+        linear_images[i]->hw_image = NULL;
+        destroy_image(linear_images[i]);
+        planar_destroy_hw_image(planar_images[i]->hw_image);
+        planar_images[i]->hw_image = NULL;
+        destroy_image(planar_images[i]);
+    }
+    linear_shutdown();
+    return 0;
+}
@@ -0,0 +1,115 @@
+// Checks the planar blitter against the linear blitter.
+// Random sprites are drawn at random positions, with random source rects
+// and flip flags, to both; the planar framebuffer is then unpacked and
+// compared pixel for pixel with the linear one.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "colour.h"
+#include "image.h"
+#include "linear.h"
+#include "planar.h"
+#include "system.h"
+
+#define FB_WIDTH 320
+#define FB_HEIGHT 200
+#define ITERATIONS 5000
+
+static void test_update_palette_slot(uint8_t idx)
+{
+}
+
+static pt_drv_video test_video = { .update_palette_slot = &test_update_palette_slot };
+
+static byte planar_fb[FB_WIDTH * FB_HEIGHT];
+
+static pt_image* test_create_sprite()
+{
+    pt_image* image = create_image(NULL, 0, 0, rand() % 2 ? 0 : -1);
+    image->width = 1 + rand() % 96;
+    image->height = 1 + rand() % 64;
+    image->pitch = get_pitch(image->width);
+    image->data = (byte*)calloc(image->pitch * image->height, sizeof(byte));
+    int pattern = rand() % 3;
+    for (int i = 0; i < image->pitch * image->height; i++) {
+        if (pattern == 0)
+            image->data[i] = rand() % 256;
+        else if (pattern == 1)
+            image->data[i] = ((i / 7) % 2) ? 0 : 1 + rand() % 255;
+        else
+            image->data[i] = (rand() % 4) ? 0 : 1 + rand() % 255;
+    }
+    byte colours[3 * 256];
+    byte alpha[256];
+    for (int i = 0; i < 256; i++) {
+        colours[3 * i] = rand() % 256;
+        colours[3 * i + 1] = rand() % 256;
+        colours[3 * i + 2] = rand() % 256;
+        alpha[i] = (rand() % 8) ? 0xff : 0x00;
+    }
+    pt_image_palette* palette = create_image_palette(colours, alpha);
+    if (palette) {
+        destroy_image_palette(image->palette);
+        image->palette = palette;
+    }
+    return image;
+}
+
+int main(int argc, char** argv)
+{
+    pt_sys.video = &test_video;
+    palette_init();
+    linear_init(FB_WIDTH, FB_HEIGHT);
+    byte* linear_fb = linear_get_framebuffer();
+    int plane_size = (FB_WIDTH / 4) * FB_HEIGHT;
+
+    srand(argc > 1 ? atoi(argv[1]) : 1);
+    int failures = 0;
+    for (int i = 0; i < ITERATIONS; i++) {
+        pt_image* image = test_create_sprite();
+        int16_t x = rand() % (FB_WIDTH + 64) - 32;
+        int16_t y = rand() % (FB_HEIGHT + 64) - 32;
+        uint8_t flags = rand() % 4;
+        int16_t left = rand() % 2 ? 0 : rand() % image->width;
+        int16_t top = rand() % 2 ? 0 : rand() % image->height;
+        int16_t right = rand() % 2 ? image->width : left + rand() % (image->width - left + 1);
+        int16_t bottom = rand() % 2 ? image->height : top + rand() % (image->height - top + 1);
+
+        // Same background in both framebuffers
+        uint8_t background = rand() % 256;
+        linear_clear(background);
+        memset(planar_fb, background, sizeof(planar_fb));
+
+        linear_blit_image(image, x, y, flags, left, top, right, bottom);
+        linear_destroy_hw_image(image->hw_image);
+        image->hw_image = NULL;
+        planar_blit_image(planar_fb, FB_WIDTH, FB_HEIGHT, image, x, y, flags, left, top, right, bottom);
+        planar_destroy_hw_image(image->hw_image);
+        image->hw_image = NULL;
+
+        for (int py = 0; py < FB_HEIGHT; py++) {
+            int px = 0;
+            for (; px < FB_WIDTH; px++) {
+                byte expected = linear_fb[py * FB_WIDTH + px];
+                byte actual = planar_fb[(px % 4) * plane_size + py * (FB_WIDTH / 4) + px / 4];
+                if (expected != actual)
+                    break;
+            }
+            if (px < FB_WIDTH) {
+                if (failures < 10) {
+                    printf("FAIL %d: %dx%d sprite at %d,%d, flags %d, rect %d %d %d %d; pixel %d,%d differs\n", i,
+                        image->width, image->height, x, y, flags, left, top, right, bottom, px, py);
+                }
+                failures++;
+                break;
+            }
+        }
+        destroy_image(image);
+    }
+    linear_shutdown();
+
+    printf("%d of %d blits matched\n", ITERATIONS - failures, ITERATIONS);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,133 @@
+// Times text layout with one of the example fonts, and counts how many
+// heap allocations each call to create_text makes.
+// Usage: text_bench EXAMPLE_DIR [LINES] [FONT]
+// Allocations are counted by linking with -Wl,--wrap=malloc (and calloc,
+// realloc), which needs the GNU linker; see meson.build.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "font.h"
+#include "fs.h"
+#include "text.h"
+
+#define DEFAULT_LINES 5000
+#define LINE_WIDTH 200
+#define ROUNDS 10
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t nmemb, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+static size_t alloc_count = 0;
+
+void* __wrap_malloc(size_t size)
+{
+    alloc_count++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t nmemb, size_t size)
+{
+    alloc_count++;
+    return __real_calloc(nmemb, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+    alloc_count++;
+    return __real_realloc(ptr, size);
+}
+
+static const char* words[] = { "the", "eagle", "has", "landed", "on", "a", "small", "island", "in", "the", "middle",
+    "of", "nowhere,", "and", "nobody", "seems", "to", "know", "why.", "Perhaps", "it", "was", "looking", "for",
+    "something", "entirely", "different", "altogether!", "\"Hello\"", "said", "Tom." };
+
+static uint64_t bench_micros()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// A sentence of a few words, long enough to wrap now and then
+static char* bench_create_line(size_t* length)
+{
+    char buffer[512] = { 0 };
+    size_t used = 0;
+    int word_count = 2 + rand() % 14;
+    for (int i = 0; i < word_count; i++) {
+        const char* word = words[rand() % (sizeof(words) / sizeof(words[0]))];
+        const char* sep = i == 0 ? "" : (rand() % 20 ? " " : "\n");
+        used += snprintf(buffer + used, sizeof(buffer) - used, "%s%s", sep, word);
+    }
+    char* result = (char*)malloc(used + 1);
+    memcpy(result, buffer, used + 1);
+    *length = used;
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        printf("Usage: %s EXAMPLE_DIR [LINES] [FONT]\n", argv[0]);
+        return 1;
+    }
+    int line_count = argc > 2 ? atoi(argv[2]) : DEFAULT_LINES;
+    if (line_count <= 0)
+        line_count = DEFAULT_LINES;
+    const char* font_name = argc > 3 ? argv[3] : "assets/eagle.fnt";
+
+    fs_init(argv[0], 1, (const char**)&argv[1]);
+    char* font_path = (char*)malloc(strlen(font_name) + 1);
+    strcpy(font_path, font_name);
+    pt_font* font = create_font(font_path);
+    if (!font) {
+        printf("Unable to load font %s from %s\n", font_name, argv[1]);
+        return 1;
+    }
+
+    srand(1);
+    char** lines = (char**)calloc(line_count, sizeof(char*));
+    size_t* lengths = (size_t*)calloc(line_count, sizeof(size_t));
+    for (int i = 0; i < line_count; i++)
+        lines[i] = bench_create_line(&lengths[i]);
+
+    size_t worst = 0;
+    size_t allocs = 0;
+    size_t glyphs = 0;
+    for (int i = 0; i < line_count; i++) {
+        size_t before = alloc_count;
+        pt_text* text = create_text((const byte*)lines[i], lengths[i], font, LINE_WIDTH, 1 + i % 3);
+        size_t made = alloc_count - before;
+        allocs += made;
+        if (made > worst)
+            worst = made;
+        if (text)
+            glyphs += text->glyph_count;
+        destroy_text(text);
+    }
+    printf("%d lines, %zu glyphs: %.2f allocations per layout, %zu at most\n", line_count, glyphs,
+        (double)allocs / line_count, worst);
+
+    uint64_t start = bench_micros();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < line_count; i++)
+            destroy_text(create_text((const byte*)lines[i], lengths[i], font, LINE_WIDTH, 1 + i % 3));
+    }
+    uint64_t layout_time = bench_micros() - start;
+    int layouts = ROUNDS * line_count;
+    printf("create_text: %llu us for %d layouts (%.3f us/layout)\n", (unsigned long long)layout_time, layouts,
+        (double)layout_time / layouts);
+
+    for (int i = 0; i < line_count; i++)
+        free(lines[i]);
+    free(lines);
+    free(lengths);
+    destroy_font(font);
+    fs_shutdown();
+    // create_text is meant to make one allocation, however long the text
+    return worst > 1 ? 1 : 0;
+}
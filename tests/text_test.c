@@ -0,0 +1,171 @@
+// Checks drawing text layouts straight to the screen against drawing the
+// image made by text_to_image.
+// Random text is laid out with the example fonts and revealed a few glyphs
+// at a time, then drawn both ways to the linear framebuffer and compared
+// pixel for pixel, with and without dithered colours.
+// Usage: text_test EXAMPLE_DIR [SEED]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "colour.h"
+#include "font.h"
+#include "fs.h"
+#include "image.h"
+#include "linear.h"
+#include "system.h"
+#include "text.h"
+
+#define FB_WIDTH 320
+#define FB_HEIGHT 200
+#define ITERATIONS 200
+
+static void test_update_palette_slot(uint8_t idx)
+{
+}
+
+static pt_drv_video test_video = {
+    .blit_image = &linear_blit_image,
+    .update_palette_slot = &test_update_palette_slot,
+    .destroy_hw_image = &linear_destroy_hw_image,
+};
+
+static const char* fonts[] = { "assets/eagle.fnt", "assets/tiny.fnt" };
+
+static const char* words[] = { "the", "eagle", "has", "landed", "on", "a", "small", "island", "in", "middle", "of",
+    "nowhere,", "and", "nobody", "knows", "why.", "Wait!", "\"Hello\"", "said", "Tom.", "fjord", "quiz", "Vaxy" };
+
+static byte reference_fb[FB_WIDTH * FB_HEIGHT];
+
+static char* test_create_string(size_t* length)
+{
+    char buffer[512] = { 0 };
+    size_t used = 0;
+    int word_count = 1 + rand() % 16;
+    for (int i = 0; i < word_count; i++) {
+        const char* word = words[rand() % (sizeof(words) / sizeof(words[0]))];
+        const char* sep = i == 0 ? "" : (rand() % 8 ? " " : "\n");
+        used += snprintf(buffer + used, sizeof(buffer) - used, "%s%s", sep, word);
+    }
+    char* result = (char*)malloc(used + 1);
+    memcpy(result, buffer, used + 1);
+    *length = used;
+    return result;
+}
+
+// Draw the first count glyphs the slow way: cut the words short, render
+// the whole layout to an image and blit it.
+static void test_draw_reference(pt_text* text, int16_t x, int16_t y, size_t count)
+{
+    size_t* saved = (size_t*)calloc(text->glyph_count + 1, sizeof(size_t));
+    size_t word_idx = 0;
+    size_t left = count;
+    for (int i = 0; i < text->line_count; i++) {
+        for (int j = 0; j < text->lines[i]->word_count; j++) {
+            pt_text_word* word = text->lines[i]->words[j];
+            saved[word_idx++] = word->glyph_count;
+            if (word->glyph_count > left)
+                word->glyph_count = left;
+            left -= word->glyph_count;
+        }
+    }
+
+    pt_image* image = text_to_image(
+        text, text->colours[0], text->colours[1], text->colours[2], text->colours[3], text->colours[4], text->colours[5]);
+    if (image) {
+        image_blit(image, x, y, 0);
+        destroy_image(image);
+    }
+
+    word_idx = 0;
+    for (int i = 0; i < text->line_count; i++) {
+        for (int j = 0; j < text->lines[i]->word_count; j++)
+            text->lines[i]->words[j]->glyph_count = saved[word_idx++];
+    }
+    free(saved);
+}
+
+static bool test_compare(pt_text* text, int16_t x, int16_t y, size_t count, byte* fb)
+{
+    linear_clear(3);
+    test_draw_reference(text, x, y, count);
+    memcpy(reference_fb, fb, sizeof(reference_fb));
+    linear_clear(3);
+    text_draw(text, x, y, count);
+    return memcmp(reference_fb, fb, sizeof(reference_fb)) == 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        printf("Usage: %s EXAMPLE_DIR [SEED]\n", argv[0]);
+        return 1;
+    }
+    pt_sys.video = &test_video;
+    palette_init();
+    linear_init(FB_WIDTH, FB_HEIGHT);
+    byte* fb = linear_get_framebuffer();
+    fs_init(argv[0], 1, (const char**)&argv[1]);
+    srand(argc > 2 ? atoi(argv[2]) : 1);
+
+    int failures = 0;
+    int checks = 0;
+    for (size_t f = 0; f < sizeof(fonts) / sizeof(fonts[0]); f++) {
+        char* font_path = (char*)malloc(strlen(fonts[f]) + 1);
+        strcpy(font_path, fonts[f]);
+        pt_font* font = create_font(font_path);
+        if (!font) {
+            printf("Unable to load font %s from %s\n", fonts[f], argv[1]);
+            return 1;
+        }
+        // Undithered, then dithered to the EGA palette
+        for (int dithered = 0; dithered < 2; dithered++) {
+            if (dithered)
+                palette_set_remapper(REMAPPER_EGA, REMAPPER_MODE_HALF);
+            else
+                palette_set_remapper(REMAPPER_NONE, REMAPPER_MODE_NEAREST);
+            for (int i = 0; i < ITERATIONS; i++) {
+                size_t length = 0;
+                char* string = test_create_string(&length);
+                pt_text* text = create_text((const byte*)string, length, font, 20 + rand() % 200, 1 + rand() % 3);
+                free(string);
+                if (!text)
+                    continue;
+                for (int c = 0; c < 6; c++)
+                    text->colours[c] = (rand() % 6) * 0x33;
+                int16_t x = rand() % (FB_WIDTH + 40) - 40;
+                int16_t y = rand() % (FB_HEIGHT + 20) - 20;
+
+                // Reveal a few glyphs at a time, then go back a bit and show the lot
+                size_t counts[16];
+                int count_total = 0;
+                size_t count = 0;
+                while ((count_total < 13) && (count < text->glyph_count)) {
+                    counts[count_total++] = count;
+                    count += 1 + rand() % 8;
+                }
+                counts[count_total++] = text->glyph_count;
+                counts[count_total++] = text->glyph_count ? rand() % text->glyph_count : 0;
+                counts[count_total++] = SIZE_MAX;
+                for (int c = 0; c < count_total; c++) {
+                    checks++;
+                    if (!test_compare(text, x, y, counts[c], fb)) {
+                        if (failures < 10) {
+                            printf("%s, %s: iteration %d, %zu of %zu glyphs at (%d, %d) differ\n", fonts[f],
+                                dithered ? "dithered" : "undithered", i, counts[c], text->glyph_count, x, y);
+                        }
+                        failures++;
+                    }
+                }
+                destroy_text(text);
+            }
+        }
+        destroy_font(font);
+    }
+
+    printf("%d of %d draws matched\n", checks - failures, checks);
+    linear_shutdown();
+    fs_shutdown();
+    return failures ? 1 : 0;
+}